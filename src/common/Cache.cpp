@@ -0,0 +1,171 @@
+#include "Cache.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace openMVG_ofx {
+namespace Common {
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+//Only the files created by the plugins are removed, the folder may be shared.
+//Localization results (localizer_) are never removed, a saved script may still use them.
+const char* const kCleanedFilePrefixes[] = {"lensdetect_", "sfm_"};
+
+const std::time_t kCacheFileMaxAge = 30 * 24 * 3600;
+const std::uintmax_t kCacheFolderMaxSize = 20ull * 1024 * 1024 * 1024;
+
+//Files used recently may be opened by another host
+const std::time_t kCacheFileInUseAge = 24 * 3600;
+
+bool isCleanedFile(const bfs::path &path)
+{
+  const std::string fileName = path.filename().string();
+  for(const char *prefix : kCleanedFilePrefixes)
+  {
+    if(fileName.compare(0, std::char_traits<char>::length(prefix), prefix) == 0)
+      return true;
+  }
+  return false;
+}
+
+void cleanCacheFolder(const bfs::path &folder)
+{
+  struct CacheFile
+  {
+    bfs::path path;
+    std::time_t lastUse;
+    std::uintmax_t size;
+  };
+
+  const std::time_t now = std::time(nullptr);
+  std::vector<CacheFile> files;
+  std::uintmax_t totalSize = 0;
+  std::size_t nbRemoved = 0;
+
+  boost::system::error_code error;
+  for(bfs::directory_iterator it(folder, error), end; !error && it != end; it.increment(error))
+  {
+    const bfs::path &path = it->path();
+    boost::system::error_code fileError;
+    if(!isCleanedFile(path) || !bfs::is_regular_file(path, fileError))
+      continue;
+
+    const CacheFile file = {path, bfs::last_write_time(path, fileError), bfs::file_size(path, fileError)};
+    if(fileError)
+      continue;
+
+    if(now - file.lastUse > kCacheFileMaxAge)
+    {
+      nbRemoved += bfs::remove(path, fileError);
+      continue;
+    }
+    files.push_back(file);
+    totalSize += file.size;
+  }
+
+  //Least recently used first
+  std::sort(files.begin(), files.end(), [](const CacheFile &a, const CacheFile &b) { return a.lastUse < b.lastUse; });
+  for(const CacheFile &file : files)
+  {
+    if(totalSize <= kCacheFolderMaxSize || now - file.lastUse < kCacheFileInUseAge)
+      break;
+    boost::system::error_code fileError;
+    if(bfs::remove(file.path, fileError))
+    {
+      totalSize -= file.size;
+      ++nbRemoved;
+    }
+  }
+
+  if(nbRemoved > 0)
+  {
+    std::cout << "[Cache] " << nbRemoved << " unused files removed from " << folder.string() << std::endl;
+  }
+}
+
+std::string resolveCacheFolder()
+{
+  std::vector<bfs::path> candidates;
+
+  if(const char *cachePath = std::getenv("OFXMVG_CACHE_PATH"))
+  {
+    candidates.emplace_back(cachePath);
+  }
+#ifdef _WIN32
+  if(const char *localAppData = std::getenv("LOCALAPPDATA"))
+  {
+    candidates.push_back(bfs::path(localAppData) / "ofxMVG" / "cache");
+  }
+#else
+  if(const char *home = std::getenv("HOME"))
+  {
+    candidates.push_back(bfs::path(home) / ".cache" / "ofxMVG");
+  }
+#endif
+
+  for(const bfs::path &candidate : candidates)
+  {
+    boost::system::error_code error;
+    bfs::create_directories(candidate, error);
+    if(bfs::is_directory(candidate, error))
+    {
+      return candidate.string();
+    }
+    std::cerr << "[Cache] Warning: can't use cache folder " << candidate.string() << std::endl;
+  }
+
+  const bfs::path tempFolder = bfs::temp_directory_path() / "ofxMVG";
+  bfs::create_directories(tempFolder);
+  return tempFolder.string();
+}
+
+} //namespace
+
+std::string getCacheFolder()
+{
+  const std::string folder = resolveCacheFolder();
+
+  static std::once_flag cleanFlag;
+  std::call_once(cleanFlag, [&folder]() { cleanCacheFolder(folder); });
+  return folder;
+}
+
+void touchCacheFile(const std::string &filePath)
+{
+  boost::system::error_code error;
+  bfs::last_write_time(filePath, std::time(nullptr), error);
+}
+
+std::string createCacheFilePath(const std::string &prefix, const std::string &extension, const std::string &folder)
+{
+  const bfs::path fileName = bfs::unique_path(prefix + "_%%%%-%%%%-%%%%-%%%%" + extension);
+  if(folder.empty())
+  {
+    return (bfs::path(getCacheFolder()) / fileName).string();
+  }
+  boost::system::error_code error;
+  bfs::create_directories(folder, error);
+  return (bfs::path(folder) / fileName).string();
+}
+
+std::string Hasher::toString() const
+{
+  char buffer[17];
+  std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(_value));
+  return std::string(buffer);
+}
+
+} //namespace Common
+} //namespace openMVG_ofx
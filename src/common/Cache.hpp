@@ -0,0 +1,78 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace openMVG_ofx {
+namespace Common {
+
+/**
+ * @brief Get the folder used to store the plugins cache files
+ * OFXMVG_CACHE_PATH if defined, else ~/.cache/ofxMVG, else a temporary folder.
+ * The folder is created if needed. The first time, the detections and SfM data
+ * snapshots unused for a month are removed, then the least recently used ones
+ * while the folder is over its size limit. Localization results are never
+ * removed, a saved script may still use them.
+ * @return the folder path
+ */
+std::string getCacheFolder();
+
+/**
+ * @brief Mark a cache file as used, so the cache folder cleanup keeps it
+ * Files written are already marked.
+ * @param[in] filePath
+ */
+void touchCacheFile(const std::string &filePath);
+
+/**
+ * @brief Get a new unique file path in a cache folder
+ * @param[in] prefix - file name prefix
+ * @param[in] extension - file extension, with the dot
+ * @param[in] folder - created if needed, empty for getCacheFolder()
+ * @return the file path, the file is not created
+ */
+std::string createCacheFilePath(const std::string &prefix, const std::string &extension, const std::string &folder = std::string());
+
+/**
+ * @brief 64 bits FNV-1a hash
+ * Not cryptographic, only used to identify cache content.
+ */
+class Hasher
+{
+public:
+  void update(const void *data, std::size_t size)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for(std::size_t i = 0; i < size; ++i)
+    {
+      _value = (_value ^ bytes[i]) * 1099511628211ull;
+    }
+  }
+
+  void update(const std::string &value)
+  {
+    update(value.data(), value.size());
+  }
+
+  template<typename T>
+  void updateValue(const T &value)
+  {
+    update(&value, sizeof(T));
+  }
+
+  std::uint64_t value() const
+  {
+    return _value;
+  }
+
+  /**
+   * @brief Hash value as 16 hexadecimal digits
+   */
+  std::string toString() const;
+
+private:
+  std::uint64_t _value = 14695981039346656037ull;
+};
+
+} //namespace Common
+} //namespace openMVG_ofx
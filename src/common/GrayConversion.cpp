@@ -0,0 +1,215 @@
+#include "GrayConversion.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OFX_MVG_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(OFX_MVG_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define OFX_MVG_HAVE_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace openMVG_ofx {
+namespace Common {
+
+namespace {
+
+//Same weights as openMVG::image::Rgb2Gray
+const float kRedWeight = 0.2126f;
+const float kGreenWeight = 0.7152f;
+const float kBlueWeight = 0.0722f;
+
+inline unsigned char toGRAY8(float gray)
+{
+  gray *= 255.f;
+  //NaN goes to 0
+  gray = (gray > 0.f) ? ((gray < 255.f) ? gray : 255.f) : 0.f;
+  return static_cast<unsigned char>(gray);
+}
+
+void convertRowScalar(const float *src, std::size_t width, std::size_t nbChannels, EGrayConversion conversion, unsigned char *dst)
+{
+  if(conversion == eGrayFromFirstChannel || nbChannels < 3)
+  {
+    for(std::size_t x = 0; x < width; ++x, src += nbChannels)
+    {
+      dst[x] = toGRAY8(src[0]);
+    }
+    return;
+  }
+  for(std::size_t x = 0; x < width; ++x, src += nbChannels)
+  {
+    dst[x] = toGRAY8(kRedWeight * src[0] + kGreenWeight * src[1] + kBlueWeight * src[2]);
+  }
+}
+
+#ifdef OFX_MVG_HAVE_SSE2
+
+/**
+ * @brief Load 4 pixels and split the first three channels
+ */
+template<std::size_t NbChannels>
+inline void load4(const float *src, __m128 &r, __m128 &g, __m128 &b);
+
+template<>
+inline void load4<1>(const float *src, __m128 &r, __m128 &g, __m128 &b)
+{
+  r = g = b = _mm_loadu_ps(src);
+}
+
+template<>
+inline void load4<3>(const float *src, __m128 &r, __m128 &g, __m128 &b)
+{
+  // p0 = r0 g0 b0 r1 | p1 = g1 b1 r2 g2 | p2 = b2 r3 g3 b3
+  const __m128 p0 = _mm_loadu_ps(src);
+  const __m128 p1 = _mm_loadu_ps(src + 4);
+  const __m128 p2 = _mm_loadu_ps(src + 8);
+
+  const __m128 r23 = _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(1, 1, 2, 2)); // r2 r2 r3 r3
+  r = _mm_shuffle_ps(p0, r23, _MM_SHUFFLE(2, 0, 3, 0));
+
+  const __m128 g01 = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(0, 0, 1, 1)); // g0 g0 g1 g1
+  const __m128 g23 = _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(2, 2, 3, 3)); // g2 g2 g3 g3
+  g = _mm_shuffle_ps(g01, g23, _MM_SHUFFLE(2, 0, 2, 0));
+
+  const __m128 b01 = _mm_shuffle_ps(p0, p1, _MM_SHUFFLE(1, 1, 2, 2)); // b0 b0 b1 b1
+  const __m128 b23 = _mm_shuffle_ps(p2, p2, _MM_SHUFFLE(3, 3, 0, 0)); // b2 b2 b3 b3
+  b = _mm_shuffle_ps(b01, b23, _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+template<>
+inline void load4<4>(const float *src, __m128 &r, __m128 &g, __m128 &b)
+{
+  __m128 p0 = _mm_loadu_ps(src);
+  __m128 p1 = _mm_loadu_ps(src + 4);
+  __m128 p2 = _mm_loadu_ps(src + 8);
+  __m128 p3 = _mm_loadu_ps(src + 12);
+  _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+  r = p0;
+  g = p1;
+  b = p2;
+}
+
+/**
+ * @brief Scale, clamp and truncate 4 gray values
+ */
+inline __m128i toGRAY32(__m128 gray)
+{
+  gray = _mm_mul_ps(gray, _mm_set1_ps(255.f));
+  //_mm_max_ps returns its second operand for NaN
+  gray = _mm_max_ps(gray, _mm_setzero_ps());
+  gray = _mm_min_ps(gray, _mm_set1_ps(255.f));
+  return _mm_cvttps_epi32(gray);
+}
+
+template<std::size_t NbChannels>
+void convertRowSSE2(const float *src, std::size_t width, EGrayConversion conversion, unsigned char *dst)
+{
+  const __m128 redWeight = _mm_set1_ps(kRedWeight);
+  const __m128 greenWeight = _mm_set1_ps(kGreenWeight);
+  const __m128 blueWeight = _mm_set1_ps(kBlueWeight);
+  const bool fromRGB = (conversion == eGrayFromRGB) && (NbChannels >= 3);
+
+  std::size_t x = 0;
+  for(; x + 8 <= width; x += 8)
+  {
+    __m128i gray[2];
+    for(std::size_t i = 0; i < 2; ++i)
+    {
+      __m128 r, g, b;
+      load4<NbChannels>(src + (x + 4 * i) * NbChannels, r, g, b);
+      const __m128 value = fromRGB ?
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, redWeight), _mm_mul_ps(g, greenWeight)), _mm_mul_ps(b, blueWeight)) :
+          r;
+      gray[i] = toGRAY32(value);
+    }
+    //Values are in [0, 255], saturation doesn't change them
+    const __m128i gray16 = _mm_packs_epi32(gray[0], gray[1]);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(gray16, gray16));
+  }
+  convertRowScalar(src + x * NbChannels, width - x, NbChannels, conversion, dst + x);
+}
+
+#endif //OFX_MVG_HAVE_SSE2
+
+#ifdef OFX_MVG_HAVE_AVX2_DISPATCH
+
+__attribute__((target("avx2")))
+void convertRowRGBA_AVX2(const float *src, std::size_t width, unsigned char *dst)
+{
+  // Two pixels per register, alpha weight is 0
+  const __m256 weights = _mm256_setr_ps(kRedWeight, kGreenWeight, kBlueWeight, 0.f,
+                                        kRedWeight, kGreenWeight, kBlueWeight, 0.f);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 maxValue = _mm256_set1_ps(255.f);
+
+  std::size_t x = 0;
+  for(; x + 8 <= width; x += 8)
+  {
+    const float *pixels = src + x * 4;
+    //Alpha is zeroed so a non finite alpha can't spoil the sum
+    const __m256 p01 = _mm256_mul_ps(_mm256_blend_ps(_mm256_loadu_ps(pixels), zero, 0x88), weights);
+    const __m256 p23 = _mm256_mul_ps(_mm256_blend_ps(_mm256_loadu_ps(pixels + 8), zero, 0x88), weights);
+    const __m256 p45 = _mm256_mul_ps(_mm256_blend_ps(_mm256_loadu_ps(pixels + 16), zero, 0x88), weights);
+    const __m256 p67 = _mm256_mul_ps(_mm256_blend_ps(_mm256_loadu_ps(pixels + 24), zero, 0x88), weights);
+
+    // lanes: (p0 p2 p4 p6 | p1 p3 p5 p7)
+    const __m256 sum = _mm256_hadd_ps(_mm256_hadd_ps(p01, p23), _mm256_hadd_ps(p45, p67));
+    __m256 gray = _mm256_permutevar8x32_ps(sum, order);
+
+    gray = _mm256_mul_ps(gray, maxValue);
+    gray = _mm256_max_ps(gray, zero);
+    gray = _mm256_min_ps(gray, maxValue);
+    const __m256i gray32 = _mm256_cvttps_epi32(gray);
+
+    const __m128i gray16 = _mm_packs_epi32(_mm256_castsi256_si128(gray32), _mm256_extracti128_si256(gray32, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(gray16, gray16));
+  }
+  convertRowScalar(src + x * 4, width - x, 4, eGrayFromRGB, dst + x);
+}
+
+bool hasAVX2()
+{
+  static const bool result = __builtin_cpu_supports("avx2");
+  return result;
+}
+
+#endif //OFX_MVG_HAVE_AVX2_DISPATCH
+
+} //namespace
+
+void convertRowToGRAY8(const float *src, std::size_t width, std::size_t nbChannels, EGrayConversion conversion, unsigned char *dst)
+{
+#ifdef OFX_MVG_HAVE_AVX2_DISPATCH
+  if(nbChannels == 4 && conversion == eGrayFromRGB && hasAVX2())
+  {
+    convertRowRGBA_AVX2(src, width, dst);
+    return;
+  }
+#endif
+
+#ifdef OFX_MVG_HAVE_SSE2
+  switch(nbChannels)
+  {
+    case 1: convertRowSSE2<1>(src, width, conversion, dst); return;
+    case 3: convertRowSSE2<3>(src, width, conversion, dst); return;
+    case 4: convertRowSSE2<4>(src, width, conversion, dst); return;
+    default: break;
+  }
+#endif
+
+  convertRowScalar(src, width, nbChannels, conversion, dst);
+}
+
+void convertToGRAY8(const Image<float> &inputImage, EGrayConversion conversion, unsigned char *output, std::size_t outputRowBytes)
+{
+  for(std::size_t y = 0; y < inputImage.getHeight(); ++y)
+  {
+    convertRowToGRAY8(inputImage.getPixel(0, y), inputImage.getWidth(), inputImage.getNbChannels(), conversion, output + y * outputRowBytes);
+  }
+}
+
+} //namespace Common
+} //namespace openMVG_ofx
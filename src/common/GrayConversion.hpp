@@ -0,0 +1,37 @@
+#pragma once
+#include "Image.hpp"
+#include <cstddef>
+
+namespace openMVG_ofx {
+namespace Common {
+
+enum EGrayConversion
+{
+    eGrayFromRGB = 0,     //luminance of the first three channels
+    eGrayFromFirstChannel //GGG images, the first channel is the gray value
+};
+
+/**
+ * @brief Convert a row of interleaved float pixels to 8 bits gray values
+ * Values are clamped to [0, 1] then truncated, as (unsigned char)(gray * 255.f).
+ * SSE2 or AVX2 kernels are used when available for 1, 3 and 4 channels.
+ * @param[in] src - first pixel of the row
+ * @param[in] width - number of pixels
+ * @param[in] nbChannels - number of interleaved channels
+ * @param[in] conversion
+ * @param[out] dst - width bytes
+ */
+void convertRowToGRAY8(const float *src, std::size_t width, std::size_t nbChannels, EGrayConversion conversion, unsigned char *dst);
+
+/**
+ * @brief Convert a float image to a 8 bits gray buffer
+ * Rows are read with getPixel, so any image orientation is supported.
+ * @param[in] inputImage
+ * @param[in] conversion
+ * @param[out] output - first row of the output buffer
+ * @param[in] outputRowBytes - distance in bytes between two output rows
+ */
+void convertToGRAY8(const Image<float> &inputImage, EGrayConversion conversion, unsigned char *output, std::size_t outputRowBytes);
+
+} //namespace Common
+} //namespace openMVG_ofx
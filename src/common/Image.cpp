@@ -1,6 +1,7 @@
 #include "Image.hpp"
 #include <cassert>
 #include <iostream>
+#include <utility>
 
 namespace openMVG_ofx {
 namespace Common {
@@ -22,10 +23,42 @@ Image<DataType>::Image(OFX::Image *imgData, const EImageOrientation orientation)
   std::size_t width = imgData->getRegionOfDefinition().x2 - imgData->getRegionOfDefinition().x1;
   std::size_t height = imgData->getRegionOfDefinition().y2 - imgData->getRegionOfDefinition().y1;
   
-  //copy the pointer for delete
+  setExternalBuffer((DataType*)imgData->getPixelData(), width, height, imgData->getPixelComponentCount(), imgData->getRowBytes() / sizeof(DataType), orientation);
+
+  //copy the pointer, the OFX image isn't owned
   _imgPtr = imgData;
+}
 
-  setExternalBuffer((DataType*)imgData->getPixelData(), width, height, imgData->getPixelComponentCount(), imgData->getRowBytes() / sizeof(DataType), orientation);
+template<typename DataType>
+Image<DataType>::Image(Image &&image)
+{
+  *this = std::move(image);
+}
+
+template<typename DataType>
+Image<DataType>& Image<DataType>::operator=(Image &&image)
+{
+  if(this != &image)
+  {
+    clear();
+    _imgPtr = image._imgPtr;
+    _data = image._data;
+    _hasOwnership = image._hasOwnership;
+    _width = image._width;
+    _height = image._height;
+    _nbChannels = image._nbChannels;
+    _size = image._size;
+    _nbPixels = image._nbPixels;
+    _rowBufferSize = image._rowBufferSize;
+    _channelQuantization = image._channelQuantization;
+
+    //The moved image doesn't release the buffer anymore
+    image._imgPtr = nullptr;
+    image._data = nullptr;
+    image._hasOwnership = 0;
+    image.clear();
+  }
+  return *this;
 }
 
 template<typename DataType>
@@ -75,15 +108,16 @@ void Image<DataType>::clear()
 {
   if(_hasOwnership)
   {
-    delete _imgPtr;
-    delete _data;
+    delete[] _data;
   }
+  _imgPtr = nullptr;
   _data = nullptr;
   _hasOwnership = 0;
   _width = 0;
   _height = 0;
   _size = 0;
   _nbPixels = 0;
+  _rowBufferSize = 0;
 }
 
 template<typename DataType>
@@ -211,6 +245,15 @@ void Image<DataType>::copyFrom(const Image &other)
   }
 }
 
+template<typename DataType>
+Image<DataType> Image<DataType>::clone() const
+{
+  Image<DataType> image(getWidth(), getHeight(), getNbChannels());
+  image._channelQuantization = _channelQuantization;
+  image.copyFrom(*this);
+  return image;
+}
+
 template<typename DataType>
 void Image<DataType>::checkSameDimensions(const std::vector< Image<DataType> > &images)
 {
@@ -37,10 +37,24 @@ public:
   Image(OFX::Image *imgData, const EImageOrientation orientation = eOrientationBottomUp);
 
   /**
-   * @brief Copy constructor 
-   * @param[in] image
+   * @brief Images aren't implicitly copied, use clone
    */
-  //Image(const Image &image) = delete;
+  Image(const Image &image) = delete;
+  Image& operator=(const Image &image) = delete;
+
+  /**
+   * @brief Move constructor
+   * The moved image is left empty.
+   * @param[in,out] image
+   */
+  Image(Image &&image);
+
+  /**
+   * @brief Move assignment
+   * The current buffer is released, the moved image is left empty.
+   * @param[in,out] image
+   */
+  Image& operator=(Image &&image);
 
   /**
    * @brief Destructor
@@ -50,6 +64,7 @@ public:
 
   /**
    * @brief Create image internal buffer
+   * The buffer is uninitialized.
    * @param[in] width
    * @param[in] height
    */
@@ -102,6 +117,12 @@ public:
    * @param other
    */
   void copyFrom(const Image &other);
+
+  /**
+   * @brief Deep copy in an internal buffer
+   * @return the copy, bottom-up
+   */
+  Image clone() const;
  
   
   bool hasOwnership() const
@@ -121,7 +142,8 @@ public:
 
   DataType* getPixel(std::size_t x, std::size_t y) const
   {
-    return _data + (y * _rowBufferSize) + x * _nbChannels;
+    //_rowBufferSize holds a negative stride for top-down images
+    return _data + static_cast<std::ptrdiff_t>(y) * static_cast<std::ptrdiff_t>(_rowBufferSize) + x * _nbChannels;
   }
 
   std::size_t getWidth() const
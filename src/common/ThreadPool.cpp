@@ -0,0 +1,120 @@
+#include "ThreadPool.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <exception>
+
+namespace openMVG_ofx {
+namespace Common {
+
+ThreadPool::ThreadPool(std::size_t nbThreads)
+{
+  nbThreads = getNbThreads(nbThreads);
+  _workers.reserve(nbThreads);
+  for(std::size_t i = 0; i < nbThreads; ++i)
+  {
+    _workers.emplace_back(&ThreadPool::workerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _stop = true;
+  }
+  _condition.notify_all();
+  for(std::thread &worker : _workers)
+  {
+    worker.join();
+  }
+}
+
+std::size_t ThreadPool::getNbThreads(std::size_t nbThreads)
+{
+  if(nbThreads == 0)
+  {
+    nbThreads = std::thread::hardware_concurrency();
+  }
+  return std::max(nbThreads, std::size_t(1));
+}
+
+void ThreadPool::workerLoop()
+{
+  for(;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _condition.wait(lock, [this](){ return _stop || !_tasks.empty(); });
+
+      //Pending tasks are still processed when stopping
+      if(_tasks.empty())
+      {
+        return;
+      }
+      task = std::move(_tasks.front());
+      _tasks.pop();
+    }
+    task();
+  }
+}
+
+void parallelFor(std::size_t count, std::size_t nbThreads, const std::function<void(std::size_t)> &function)
+{
+  nbThreads = std::min(ThreadPool::getNbThreads(nbThreads), count);
+
+  if(nbThreads <= 1)
+  {
+    for(std::size_t i = 0; i < count; ++i)
+    {
+      function(i);
+    }
+    return;
+  }
+
+  std::atomic<std::size_t> nextIndex(0);
+  std::exception_ptr firstException;
+  std::mutex exceptionMutex;
+
+  auto work = [&]()
+  {
+    for(std::size_t i = nextIndex++; i < count; i = nextIndex++)
+    {
+      try
+      {
+        function(i);
+      }
+      catch(...)
+      {
+        std::lock_guard<std::mutex> guard(exceptionMutex);
+        if(!firstException)
+        {
+          firstException = std::current_exception();
+        }
+        //Skip the remaining calls
+        nextIndex = count;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(nbThreads - 1);
+  for(std::size_t i = 1; i < nbThreads; ++i)
+  {
+    threads.emplace_back(work);
+  }
+  work();
+  for(std::thread &thread : threads)
+  {
+    thread.join();
+  }
+
+  if(firstException)
+  {
+    std::rethrow_exception(firstException);
+  }
+}
+
+} //namespace Common
+} //namespace openMVG_ofx
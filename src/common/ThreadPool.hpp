@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <type_traits>
+
+namespace openMVG_ofx {
+namespace Common {
+
+/**
+ * @brief Fixed size pool of worker threads
+ * Tasks are processed in submission order by the first available worker.
+ */
+class ThreadPool
+{
+public:
+
+  /**
+   * @brief Start the worker threads
+   * @param[in] nbThreads - number of workers, 0 means one per hardware thread
+   */
+  explicit ThreadPool(std::size_t nbThreads = 0);
+
+  ThreadPool(const ThreadPool &other) = delete;
+  ThreadPool& operator=(const ThreadPool &other) = delete;
+
+  /**
+   * @brief Destructor
+   * Wait for all submitted tasks then join the workers
+   */
+  ~ThreadPool();
+
+  /**
+   * @brief Add a task to the queue
+   * @param[in] task
+   * @return a future on the task result, exceptions are forwarded to it
+   */
+  template<typename Task>
+  std::future<typename std::result_of<Task()>::type> submit(Task task)
+  {
+    typedef typename std::result_of<Task()>::type ResultType;
+
+    // std::function needs a copyable target
+    std::shared_ptr< std::packaged_task<ResultType()> > packagedTask =
+            std::make_shared< std::packaged_task<ResultType()> >(std::move(task));
+    std::future<ResultType> result = packagedTask->get_future();
+    {
+      std::lock_guard<std::mutex> guard(_mutex);
+      _tasks.push([packagedTask](){ (*packagedTask)(); });
+    }
+    _condition.notify_one();
+    return result;
+  }
+
+  std::size_t getNbThreads() const
+  {
+    return _workers.size();
+  }
+
+  /**
+   * @brief Resolve a user thread count
+   * @param[in] nbThreads - 0 means one per hardware thread
+   * @return the number of threads to use, at least 1
+   */
+  static std::size_t getNbThreads(std::size_t nbThreads);
+
+private:
+  void workerLoop();
+
+  std::vector<std::thread> _workers;
+  std::queue< std::function<void()> > _tasks;
+  std::mutex _mutex;
+  std::condition_variable _condition;
+  bool _stop = false;
+};
+
+/**
+ * @brief Call function(i) for each i in [0, count) using at most nbThreads threads
+ * The calling thread takes part in the work. Blocks until all calls are done,
+ * the first exception thrown by a call is rethrown.
+ * @param[in] count
+ * @param[in] nbThreads - 0 means one per hardware thread
+ * @param[in] function
+ */
+void parallelFor(std::size_t count, std::size_t nbThreads, const std::function<void(std::size_t)> &function);
+
+} //namespace Common
+} //namespace openMVG_ofx
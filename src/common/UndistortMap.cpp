@@ -0,0 +1,200 @@
+#include "UndistortMap.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <tuple>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OFX_MVG_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace openMVG_ofx {
+namespace Common {
+
+namespace {
+
+//UndistortMapKey structure for the cameras sharing a remap table
+struct UndistortMapKey
+{
+  std::string model;
+  std::size_t width;
+  std::size_t height;
+  std::vector<double> params;
+
+  bool operator==(const UndistortMapKey &other) const
+  {
+    return std::tie(model, width, height, params) == std::tie(other.model, other.width, other.height, other.params);
+  }
+};
+
+//A 4K table takes 64MB
+const std::size_t kMaxCachedMaps = 4;
+
+std::mutex gCacheMutex;
+std::list< std::pair<UndistortMapKey, std::shared_ptr<const UndistortMap> > > gCache; //most recent first
+
+inline void lerpRGBA(const float *p00, const float *p10, const float *p01, const float *p11, float dx, float dy, float *out)
+{
+#ifdef OFX_MVG_HAVE_SSE2
+  const __m128 v00 = _mm_loadu_ps(p00);
+  const __m128 v01 = _mm_loadu_ps(p01);
+  const __m128 weightX = _mm_set1_ps(dx);
+  const __m128 top = _mm_add_ps(v00, _mm_mul_ps(weightX, _mm_sub_ps(_mm_loadu_ps(p10), v00)));
+  const __m128 bottom = _mm_add_ps(v01, _mm_mul_ps(weightX, _mm_sub_ps(_mm_loadu_ps(p11), v01)));
+  _mm_storeu_ps(out, _mm_add_ps(top, _mm_mul_ps(_mm_set1_ps(dy), _mm_sub_ps(bottom, top))));
+#else
+  for(std::size_t c = 0; c < 4; ++c)
+  {
+    const float top = p00[c] + dx * (p10[c] - p00[c]);
+    const float bottom = p01[c] + dx * (p11[c] - p01[c]);
+    out[c] = top + dy * (bottom - top);
+  }
+#endif
+}
+
+} //namespace
+
+UndistortMap::UndistortMap(const openMVG::cameras::IntrinsicBase &camera)
+  : UndistortMap(camera.w(), camera.h(), [&camera](const openMVG::Vec2 &undistorted) { return camera.get_d_pixel(undistorted); })
+{
+}
+
+UndistortMap::UndistortMap(std::size_t width, std::size_t height, const std::function<openMVG::Vec2(const openMVG::Vec2&)> &getDistortedPixel)
+  : _width(width)
+  , _height(height)
+  , _mapX(_width * _height)
+  , _mapY(_width * _height)
+{
+  parallelFor(_height, 0, [&](std::size_t y)
+  {
+    float *mapX = &_mapX[y * _width];
+    float *mapY = &_mapY[y * _width];
+    for(std::size_t x = 0; x < _width; ++x)
+    {
+      const openMVG::Vec2 distorted = getDistortedPixel(openMVG::Vec2(x, y));
+      mapX[x] = static_cast<float>(distorted(0));
+      mapY[x] = static_cast<float>(distorted(1));
+    }
+  });
+}
+
+void UndistortMap::remapRGBA(const float *src, std::ptrdiff_t srcStride, const OfxRectI &srcRegion,
+                             float *dst, std::ptrdiff_t dstStride, const OfxRectI &window) const
+{
+  const float minX = static_cast<float>(srcRegion.x1);
+  const float minY = static_cast<float>(srcRegion.y1);
+  const float maxX = static_cast<float>(srcRegion.x2 - 1);
+  const float maxY = static_cast<float>(srcRegion.y2 - 1);
+
+  for(int y = window.y1; y < window.y2; ++y)
+  {
+    const float *mapX = &_mapX[y * _width];
+    const float *mapY = &_mapY[y * _width];
+    float *out = dst + (y - window.y1) * dstStride;
+
+    for(int x = window.x1; x < window.x2; ++x, out += 4)
+    {
+      const float srcX = mapX[x];
+      const float srcY = mapY[x];
+
+      //Also false for NaN
+      if(!(srcX >= minX && srcY >= minY && srcX <= maxX && srcY <= maxY))
+      {
+        std::fill_n(out, 4, 0.f);
+        continue;
+      }
+
+      //Positive, truncation is floor
+      const int x0 = static_cast<int>(srcX);
+      const int y0 = static_cast<int>(srcY);
+      const int x1 = std::min(x0 + 1, srcRegion.x2 - 1);
+      const int y1 = std::min(y0 + 1, srcRegion.y2 - 1);
+      const float *row0 = src + (y0 - srcRegion.y1) * srcStride;
+      const float *row1 = src + (y1 - srcRegion.y1) * srcStride;
+
+      lerpRGBA(row0 + 4 * (x0 - srcRegion.x1), row0 + 4 * (x1 - srcRegion.x1),
+               row1 + 4 * (x0 - srcRegion.x1), row1 + 4 * (x1 - srcRegion.x1),
+               srcX - x0, srcY - y0, out);
+    }
+  }
+}
+
+void UndistortMap::remapGRAY8(const unsigned char *src, std::ptrdiff_t srcStride,
+                              unsigned char *dst, std::ptrdiff_t dstStride) const
+{
+  const float maxX = static_cast<float>(_width) - 1.f;
+  const float maxY = static_cast<float>(_height) - 1.f;
+
+  for(std::size_t y = 0; y < _height; ++y)
+  {
+    const float *mapX = &_mapX[y * _width];
+    const float *mapY = &_mapY[y * _width];
+    unsigned char *out = dst + y * dstStride;
+
+    for(std::size_t x = 0; x < _width; ++x)
+    {
+      const float srcX = mapX[x];
+      const float srcY = mapY[x];
+
+      if(!(srcX >= 0.f && srcY >= 0.f && srcX <= maxX && srcY <= maxY))
+      {
+        out[x] = 0;
+        continue;
+      }
+
+      const std::size_t x0 = static_cast<std::size_t>(srcX);
+      const std::size_t y0 = static_cast<std::size_t>(srcY);
+      const std::size_t x1 = std::min(x0 + 1, _width - 1);
+      const std::size_t y1 = std::min(y0 + 1, _height - 1);
+      const float dx = srcX - x0;
+      const float dy = srcY - y0;
+      const unsigned char *row0 = src + y0 * srcStride;
+      const unsigned char *row1 = src + y1 * srcStride;
+
+      const float top = row0[x0] + dx * (row0[x1] - row0[x0]);
+      const float bottom = row1[x0] + dx * (row1[x1] - row1[x0]);
+      out[x] = static_cast<unsigned char>(top + dy * (bottom - top) + 0.5f);
+    }
+  }
+}
+
+std::shared_ptr<const UndistortMap> getUndistortMap(const openMVG::cameras::IntrinsicBase &camera)
+{
+  return getUndistortMap("openMVG" + std::to_string(static_cast<int>(camera.getType())), camera.w(), camera.h(), camera.getParams(),
+                         [&camera](const openMVG::Vec2 &undistorted) { return camera.get_d_pixel(undistorted); });
+}
+
+std::shared_ptr<const UndistortMap> getUndistortMap(const std::string &model,
+                                                    std::size_t width,
+                                                    std::size_t height,
+                                                    const std::vector<double> &params,
+                                                    const std::function<openMVG::Vec2(const openMVG::Vec2&)> &getDistortedPixel)
+{
+  const UndistortMapKey key{model, width, height, params};
+
+  //Tiles of the first frame wait for a single table
+  std::lock_guard<std::mutex> guard(gCacheMutex);
+
+  for(auto it = gCache.begin(); it != gCache.end(); ++it)
+  {
+    if(it->first == key)
+    {
+      gCache.splice(gCache.begin(), gCache, it);
+      return gCache.front().second;
+    }
+  }
+
+  std::shared_ptr<const UndistortMap> map = std::make_shared<UndistortMap>(width, height, getDistortedPixel);
+  gCache.emplace_front(key, map);
+  if(gCache.size() > kMaxCachedMaps)
+  {
+    gCache.pop_back();
+  }
+  return map;
+}
+
+} //namespace Common
+} //namespace openMVG_ofx
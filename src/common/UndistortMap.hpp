@@ -0,0 +1,110 @@
+#pragma once
+#include "ofxsImageEffect.h"
+
+#include <openMVG/cameras/Camera_Intrinsics.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace openMVG_ofx {
+namespace Common {
+
+/**
+ * @brief Inverse distortion remap table of a camera
+ * For each pixel of the undistorted image, holds its position in the distorted
+ * image. Coordinates are top-down image coordinates, from the frame origin.
+ */
+class UndistortMap
+{
+public:
+
+  /**
+   * @brief Evaluate the distortion of all the pixels
+   * @param[in] camera - the map has the camera image size
+   */
+  explicit UndistortMap(const openMVG::cameras::IntrinsicBase &camera);
+
+  /**
+   * @brief Evaluate the distortion of all the pixels with a lens model
+   * @param[in] width
+   * @param[in] height
+   * @param[in] getDistortedPixel - from an undistorted pixel, thread safe
+   */
+  UndistortMap(std::size_t width, std::size_t height, const std::function<openMVG::Vec2(const openMVG::Vec2&)> &getDistortedPixel);
+
+  UndistortMap(const UndistortMap &other) = delete;
+  UndistortMap& operator=(const UndistortMap &other) = delete;
+
+  std::size_t getWidth() const
+  {
+    return _width;
+  }
+
+  std::size_t getHeight() const
+  {
+    return _height;
+  }
+
+  /**
+   * @brief Remap a window of a RGBA float image
+   * Pixels are sampled with a bilinear interpolation, all the channels are
+   * interpolated. Pixels sampled outside of the source region are set to zero.
+   * @param[in] src - address of the srcRegion first pixel
+   * @param[in] srcStride - in floats, negative for bottom-up buffers
+   * @param[in] srcRegion - source pixels available, in image coordinates
+   * @param[out] dst - address of the window first pixel
+   * @param[in] dstStride - in floats, negative for bottom-up buffers
+   * @param[in] window - pixels to compute, in image coordinates
+   */
+  void remapRGBA(const float *src, std::ptrdiff_t srcStride, const OfxRectI &srcRegion,
+                 float *dst, std::ptrdiff_t dstStride, const OfxRectI &window) const;
+
+  /**
+   * @brief Remap a whole 8 bits gray image
+   * Pixels are sampled with a bilinear interpolation, pixels sampled outside
+   * of the source image are set to zero.
+   * @param[in] src - of the map size
+   * @param[in] srcStride - in bytes
+   * @param[out] dst - of the map size
+   * @param[in] dstStride - in bytes
+   */
+  void remapGRAY8(const unsigned char *src, std::ptrdiff_t srcStride,
+                  unsigned char *dst, std::ptrdiff_t dstStride) const;
+
+private:
+  std::size_t _width;
+  std::size_t _height;
+  std::vector<float> _mapX; //negative outside of the distorted image
+  std::vector<float> _mapY;
+};
+
+/**
+ * @brief Get the remap table of a camera, shared by all the plugins
+ * The last tables used are kept, keyed by the image size, the camera model and
+ * its parameters. Thread safe.
+ * @param[in] camera
+ * @return the table
+ */
+std::shared_ptr<const UndistortMap> getUndistortMap(const openMVG::cameras::IntrinsicBase &camera);
+
+/**
+ * @brief Get the remap table of a lens model, shared by all the plugins
+ * Same cache as the openMVG cameras.
+ * @param[in] model - lens model name, distinct from the other models
+ * @param[in] width
+ * @param[in] height
+ * @param[in] params - lens model parameters
+ * @param[in] getDistortedPixel - from an undistorted pixel, only called if the table isn't cached
+ * @return the table
+ */
+std::shared_ptr<const UndistortMap> getUndistortMap(const std::string &model,
+                                                    std::size_t width,
+                                                    std::size_t height,
+                                                    const std::vector<double> &params,
+                                                    const std::function<openMVG::Vec2(const openMVG::Vec2&)> &getDistortedPixel);
+
+} //namespace Common
+} //namespace openMVG_ofx
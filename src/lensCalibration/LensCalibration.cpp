@@ -1,73 +1,485 @@
 #include "LensCalibration.hpp"
+#include "LensCalibrationSolver.hpp"
+#include "../common/GrayConversion.hpp"
+#include "../common/UndistortMap.hpp"
 
+#include <openMVG/calibration/calibration.hpp>
+#include <openMVG/cameras/Camera_undistort_image.hpp>
 #include <openMVG/image/image_converter.hpp>
 
 #include <opencv2/opencv.hpp>
 
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <sstream>
+
 namespace openMVG_ofx {
 namespace LensCalibration {
 
+namespace {
+
+inline const float* getPixelAddress(const OFX::Image &image, int x, int y)
+{
+  const OfxRectI &bounds = image.getBounds();
+  return reinterpret_cast<const float*>(static_cast<const char*>(image.getPixelData())
+                                        + static_cast<std::ptrdiff_t>(y - bounds.y1) * image.getRowBytes())
+         + static_cast<std::ptrdiff_t>(x - bounds.x1) * image.getPixelComponentCount();
+}
+
+inline float* getPixelAddress(OFX::Image &image, int x, int y)
+{
+  return const_cast<float*>(getPixelAddress(const_cast<const OFX::Image&>(image), x, y));
+}
+
+OfxRectI intersectRect(const OfxRectI &a, const OfxRectI &b)
+{
+  OfxRectI rect;
+  rect.x1 = std::max(a.x1, b.x1);
+  rect.y1 = std::max(a.y1, b.y1);
+  rect.x2 = std::max(rect.x1, std::min(a.x2, b.x2));
+  rect.y2 = std::max(rect.y1, std::min(a.y2, b.y2));
+  return rect;
+}
+
+} //namespace
 
-void convertRGBImage(const Common::Image<float>& inputImageOFX, openMVG::image::Image<openMVG::image::RGBfColor>& outputImageMVG)
+
+void convertRGB32ToGRAY8(const Common::Image<float>& inputImage, cv::Mat& outputImage)
 {
-  assert(outputImageMVG.Height() == inputImageOFX.getHeight());
-  assert(outputImageMVG.Width() == inputImageOFX.getWidth());
-  for(unsigned int y = 0; y < inputImageOFX.getHeight(); ++y)
+  assert(inputImage.getHeight() == outputImage.rows);
+  assert(inputImage.getWidth() == outputImage.cols);
+  assert(outputImage.type() == CV_8UC1);
+  Common::convertToGRAY8(inputImage, Common::eGrayFromRGB, outputImage.ptr<unsigned char>(0), outputImage.step);
+}
+
+void convertGGG32ToGRAY8(const Common::Image<float>& inputImage, cv::Mat& outputImage)
+{
+  assert(inputImage.getHeight() == outputImage.rows);
+  assert(inputImage.getWidth() == outputImage.cols);
+  assert(outputImage.type() == CV_8UC1);
+  Common::convertToGRAY8(inputImage, Common::eGrayFromFirstChannel, outputImage.ptr<unsigned char>(0), outputImage.step);
+}
+
+OfxRectI getUndistortSourceRegion(const LensCamera &camera,
+                                  const OfxRectI &frame,
+                                  const OfxRectI &window)
+{
+  const OfxRectI clippedWindow = intersectRect(window, frame);
+  if(clippedWindow.x1 == clippedWindow.x2 || clippedWindow.y1 == clippedWindow.y2)
+  {
+    return clippedWindow;
+  }
+
+  //Image coordinates are top-down from the frame origin
+  const double windowLeft = clippedWindow.x1 - frame.x1;
+  const double windowRight = clippedWindow.x2 - 1 - frame.x1;
+  const double windowTop = frame.y2 - clippedWindow.y2;
+  const double windowBottom = frame.y2 - 1 - clippedWindow.y1;
+
+  double minX = std::numeric_limits<double>::max();
+  double minY = std::numeric_limits<double>::max();
+  double maxX = std::numeric_limits<double>::lowest();
+  double maxY = std::numeric_limits<double>::lowest();
+  auto addSample = [&](std::size_t i, std::size_t j, std::size_t nbSteps)
+  {
+    const openMVG::Vec2 undistorted(windowLeft + (windowRight - windowLeft) * i / nbSteps,
+                                    windowTop + (windowBottom - windowTop) * j / nbSteps);
+    const openMVG::Vec2 distorted = camera.getDistortedPixel(undistorted);
+    minX = std::min(minX, distorted(0));
+    maxX = std::max(maxX, distorted(0));
+    minY = std::min(minY, distorted(1));
+    maxY = std::max(maxY, distorted(1));
+  };
+
+  //Denser on the border, where the distortion is the largest
+  const std::size_t nbBorderSteps = 32;
+  for(std::size_t k = 0; k <= nbBorderSteps; ++k)
   {
-    for(unsigned int x = 0; x < inputImageOFX.getWidth(); ++x)
+    addSample(k, 0, nbBorderSteps);
+    addSample(k, nbBorderSteps, nbBorderSteps);
+    addSample(0, k, nbBorderSteps);
+    addSample(nbBorderSteps, k, nbBorderSteps);
+  }
+  const std::size_t nbInnerSteps = 8;
+  for(std::size_t j = 1; j < nbInnerSteps; ++j)
+  {
+    for(std::size_t i = 1; i < nbInnerSteps; ++i)
     {
-      const float* rgbPtr = inputImageOFX.getPixel(x, y);
-      outputImageMVG(y, x) = openMVG::image::RGBfColor(rgbPtr[0], rgbPtr[1], rgbPtr[2]);
+      addSample(i, j, nbInnerSteps);
     }
   }
+
+  //Margin for the bilinear interpolation and the sampling
+  const double margin = 2.0;
+  const double frameWidth = frame.x2 - frame.x1;
+  const double frameHeight = frame.y2 - frame.y1;
+  minX = std::max(minX - margin, 0.0);
+  minY = std::max(minY - margin, 0.0);
+  maxX = std::min(maxX + margin, frameWidth - 1.0);
+  maxY = std::min(maxY + margin, frameHeight - 1.0);
+
+  OfxRectI region;
+  if(minX > maxX || minY > maxY)
+  {
+    //Only samples outside of the source
+    region.x1 = region.x2 = frame.x1;
+    region.y1 = region.y2 = frame.y1;
+    return region;
+  }
+  region.x1 = frame.x1 + static_cast<int>(std::floor(minX));
+  region.x2 = frame.x1 + static_cast<int>(std::ceil(maxX)) + 1;
+  region.y1 = frame.y2 - 1 - static_cast<int>(std::ceil(maxY));
+  region.y2 = frame.y2 - static_cast<int>(std::floor(minY));
+  return intersectRect(region, frame);
 }
 
-void convertRGBImage(const openMVG::image::Image<openMVG::image::RGBfColor>& inputImageMVG, Common::Image<float>& outputImageOFX)
+void undistortWindow(const LensCamera &camera,
+                     const OfxRectI &frame,
+                     const OFX::Image &srcImage,
+                     const OfxRectI &window,
+                     OFX::Image &dstImage)
 {
-  assert(inputImageMVG.Height() == outputImageOFX.getHeight());
-  assert(inputImageMVG.Width() == outputImageOFX.getWidth());
-  for(unsigned int y = 0; y < outputImageOFX.getHeight(); ++y)
+  const OfxRectI dstWindow = intersectRect(intersectRect(window, dstImage.getBounds()), frame);
+  const OfxRectI srcBounds = intersectRect(srcImage.getBounds(), frame);
+  if(dstWindow.x1 == dstWindow.x2 || dstWindow.y1 == dstWindow.y2)
+  {
+    return;
+  }
+
+  //The remap works in top-down image coordinates, OFX rows are bottom-up
+  const OfxRectI srcRegion = {srcBounds.x1 - frame.x1, frame.y2 - srcBounds.y2, srcBounds.x2 - frame.x1, frame.y2 - srcBounds.y1};
+  const OfxRectI imageWindow = {dstWindow.x1 - frame.x1, frame.y2 - dstWindow.y2, dstWindow.x2 - frame.x1, frame.y2 - dstWindow.y1};
+  const bool hasSource = (srcBounds.x1 != srcBounds.x2) && (srcBounds.y1 != srcBounds.y2);
+
+  std::shared_ptr<const Common::UndistortMap> undistortMap = Common::getUndistortMap(getLensModelName(camera.model),
+                                                                                     camera.width,
+                                                                                     camera.height,
+                                                                                     std::vector<double>(camera.params.begin(), camera.params.end()),
+                                                                                     [&camera](const openMVG::Vec2 &undistorted) { return camera.getDistortedPixel(undistorted); });
+  undistortMap->remapRGBA(hasSource ? getPixelAddress(srcImage, srcBounds.x1, srcBounds.y2 - 1) : nullptr,
+                          -static_cast<std::ptrdiff_t>(srcImage.getRowBytes() / sizeof(float)),
+                          srcRegion,
+                          getPixelAddress(dstImage, dstWindow.x1, dstWindow.y2 - 1),
+                          -static_cast<std::ptrdiff_t>(dstImage.getRowBytes() / sizeof(float)),
+                          imageWindow);
+}
+
+double compareUndistortWindow(const LensCamera &camera,
+                              const OFX::Image &srcImage,
+                              const OfxRectI &window,
+                              const OFX::Image &dstImage)
+{
+  const OfxRectI &frame = srcImage.getRegionOfDefinition();
+  const OfxRectI &srcBounds = srcImage.getBounds();
+  if(srcBounds.x1 != frame.x1 || srcBounds.y1 != frame.y1 || srcBounds.x2 != frame.x2 || srcBounds.y2 != frame.y2)
+  {
+    return -1.0;
+  }
+
+  //Radial K3 is checked against openMVG UndistortImage on the whole frame, it has a single focal
+  const bool useOpenMVG = (camera.model == eParamLensModelRadialK3) && (camera.params[0] == camera.params[1]);
+  openMVG::image::Image<openMVG::image::RGBfColor> referenceImage;
+  if(useOpenMVG)
+  {
+    openMVG::image::Image<openMVG::image::RGBfColor> inputImage(frame.x2 - frame.x1, frame.y2 - frame.y1);
+    for(int row = 0; row < inputImage.Height(); ++row)
+    {
+      const float *srcPtr = getPixelAddress(srcImage, frame.x1, frame.y2 - 1 - row);
+      for(int col = 0; col < inputImage.Width(); ++col, srcPtr += srcImage.getPixelComponentCount())
+      {
+        inputImage(row, col) = openMVG::image::RGBfColor(srcPtr[0], srcPtr[1], srcPtr[2]);
+      }
+    }
+    const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 cameraMVG(camera.width, camera.height, camera.params[0],
+                                                                  camera.params[2], camera.params[3],
+                                                                  camera.params[4], camera.params[5], camera.params[8]);
+    openMVG::cameras::UndistortImage(inputImage, &cameraMVG, referenceImage);
+  }
+
+  const double maxX = frame.x2 - frame.x1 - 1;
+  const double maxY = frame.y2 - frame.y1 - 1;
+  const OfxRectI compareWindow = intersectRect(intersectRect(window, dstImage.getBounds()), frame);
+  double maxDifference = 0.0;
+  for(int y = compareWindow.y1; y < compareWindow.y2; ++y)
   {
-    for(unsigned int x = 0; x < outputImageOFX.getWidth(); ++x)
+    const float *dstPtr = getPixelAddress(dstImage, compareWindow.x1, y);
+    for(int x = compareWindow.x1; x < compareWindow.x2; ++x, dstPtr += dstImage.getPixelComponentCount())
     {
-      const openMVG::image::RGBfColor& color = inputImageMVG(y, x);
-      float* rgbPtr = outputImageOFX.getPixel(x, y);
-      rgbPtr[0] = color.r();
-      rgbPtr[1] = color.g();
-      rgbPtr[2] = color.b();
-      rgbPtr[3] = 1.0;
+      double color[3] = {0.0, 0.0, 0.0};
+      if(useOpenMVG)
+      {
+        const openMVG::image::RGBfColor &reference = referenceImage(frame.y2 - 1 - y, x - frame.x1);
+        for(int c = 0; c < 3; ++c)
+        {
+          color[c] = reference(c);
+        }
+      }
+      else
+      {
+        //Bilinear interpolation, black outside of the source
+        const openMVG::Vec2 distorted = camera.getDistortedPixel(openMVG::Vec2(x - frame.x1, frame.y2 - 1 - y));
+        if(distorted(0) >= 0.0 && distorted(1) >= 0.0 && distorted(0) <= maxX && distorted(1) <= maxY)
+        {
+          const int x0 = static_cast<int>(std::floor(distorted(0)));
+          const int y0 = static_cast<int>(std::floor(distorted(1)));
+          const int x1 = std::min(x0 + 1, static_cast<int>(maxX));
+          const int y1 = std::min(y0 + 1, static_cast<int>(maxY));
+          const double fx = distorted(0) - x0;
+          const double fy = distorted(1) - y0;
+          const float *p00 = getPixelAddress(srcImage, frame.x1 + x0, frame.y2 - 1 - y0);
+          const float *p10 = getPixelAddress(srcImage, frame.x1 + x1, frame.y2 - 1 - y0);
+          const float *p01 = getPixelAddress(srcImage, frame.x1 + x0, frame.y2 - 1 - y1);
+          const float *p11 = getPixelAddress(srcImage, frame.x1 + x1, frame.y2 - 1 - y1);
+          for(int c = 0; c < 3; ++c)
+          {
+            color[c] = (1.0 - fy) * ((1.0 - fx) * p00[c] + fx * p10[c]) + fy * ((1.0 - fx) * p01[c] + fx * p11[c]);
+          }
+        }
+      }
+      for(int c = 0; c < 3; ++c)
+      {
+        maxDifference = std::max(maxDifference, std::abs(dstPtr[c] - color[c]));
+      }
     }
   }
+  return maxDifference;
 }
 
-void convertRGB32ToGRAY8(const Common::Image<float>& inputImage, cv::Mat& outputImage)
+void copyWindow(const OFX::Image &srcImage, const OfxRectI &window, OFX::Image &dstImage)
 {
-  assert(inputImage.getHeight() == outputImage.rows);
-  assert(inputImage.getWidth() == outputImage.cols);
-  for(unsigned int y = 0; y < inputImage.getHeight(); ++y)
+  const OfxRectI copyWindow = intersectRect(intersectRect(window, srcImage.getBounds()), dstImage.getBounds());
+  const std::size_t rowSize = (copyWindow.x2 - copyWindow.x1) * srcImage.getPixelComponentCount() * sizeof(float);
+
+  for(int y = copyWindow.y1; y < copyWindow.y2; ++y)
+  {
+    std::memcpy(getPixelAddress(dstImage, copyWindow.x1, y), getPixelAddress(srcImage, copyWindow.x1, y), rowSize);
+  }
+}
+
+bool findPatternCoarseToFine(const cv::Mat &grayImage, const PatternSettings &settings, std::vector<cv::Point2f> &checkerPoints, DetectionStats &stats)
+{
+  const auto startTime = std::chrono::steady_clock::now();
+  const std::size_t maxSize = std::max(grayImage.cols, grayImage.rows);
+
+  if(settings.patternType != openMVG::calibration::CHESSBOARD || settings.detectionMaxSize == 0 || maxSize <= settings.detectionMaxSize)
+  {
+    const bool found = openMVG::calibration::findPattern(settings.patternType, grayImage, settings.boardSize, checkerPoints);
+    ++stats.nbFullResolution;
+    stats.nbFound += found;
+    stats.totalTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return found;
+  }
+
+  //Coarse search, boards are rejected early without refinement
+  const double scale = static_cast<double>(maxSize) / settings.detectionMaxSize;
+  cv::Mat coarseImage;
+  cv::resize(grayImage, coarseImage, cv::Size(), 1.0 / scale, 1.0 / scale, cv::INTER_AREA);
+
+  std::vector<cv::Point2f> coarsePoints;
+  const bool found = cv::findChessboardCorners(coarseImage, settings.boardSize, coarsePoints,
+                                               CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_NORMALIZE_IMAGE | CV_CALIB_CB_FAST_CHECK);
+  if(!found)
+  {
+    ++stats.nbRejectedEarly;
+    stats.totalTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return false;
+  }
+
+  //Back to full resolution, pixel centers are at integer coordinates
+  const double scaleX = static_cast<double>(grayImage.cols) / coarseImage.cols;
+  const double scaleY = static_cast<double>(grayImage.rows) / coarseImage.rows;
+  checkerPoints.resize(coarsePoints.size());
+  for(std::size_t i = 0; i < coarsePoints.size(); ++i)
   {
-    for(unsigned int x = 0; x < inputImage.getWidth(); ++x)
+    checkerPoints[i].x = static_cast<float>((coarsePoints[i].x + 0.5) * scaleX - 0.5);
+    checkerPoints[i].y = static_cast<float>((coarsePoints[i].y + 0.5) * scaleY - 0.5);
+  }
+
+  //The search window covers the coarse error but stays inside a square
+  double minCornerDistance = std::numeric_limits<double>::max();
+  for(int row = 0; row < settings.boardSize.height; ++row)
+  {
+    for(int col = 0; col + 1 < settings.boardSize.width; ++col)
     {
-      const float* rgbPtr = inputImage.getPixel(x, y);
-      const float gray = openMVG::image::Rgb2Gray(rgbPtr[0], rgbPtr[1], rgbPtr[2]);
-      outputImage.at<unsigned char>(y, x) = (unsigned char)(gray * 255.f);
+      const cv::Point2f &a = checkerPoints[row * settings.boardSize.width + col];
+      const cv::Point2f &b = checkerPoints[row * settings.boardSize.width + col + 1];
+      minCornerDistance = std::min(minCornerDistance, static_cast<double>(std::hypot(a.x - b.x, a.y - b.y)));
     }
   }
+  const int halfWindow = std::max(3, static_cast<int>(std::min(std::ceil(2.0 * scale), minCornerDistance / 4.0)));
+
+  //Refine in the board region only
+  cv::Rect region = cv::boundingRect(checkerPoints);
+  region.x -= halfWindow + 2;
+  region.y -= halfWindow + 2;
+  region.width += 2 * (halfWindow + 2);
+  region.height += 2 * (halfWindow + 2);
+  region &= cv::Rect(0, 0, grayImage.cols, grayImage.rows);
+
+  for(cv::Point2f &point : checkerPoints)
+  {
+    point.x -= region.x;
+    point.y -= region.y;
+  }
+  cv::cornerSubPix(grayImage(region), checkerPoints, cv::Size(halfWindow, halfWindow), cv::Size(-1, -1),
+                   cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT, 30, 0.01));
+  for(cv::Point2f &point : checkerPoints)
+  {
+    point.x += region.x;
+    point.y += region.y;
+  }
+
+  ++stats.nbRefined;
+  ++stats.nbFound;
+  stats.totalTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  return true;
 }
 
-void convertGGG32ToGRAY8(const Common::Image<float>& inputImage, cv::Mat& outputImage)
+void convertToPatternImage(OFX::Image &inputImage, const PatternSettings &settings, cv::Mat &grayImage)
 {
-  assert(inputImage.getHeight() == outputImage.rows);
-  assert(inputImage.getWidth() == outputImage.cols);
-  for(unsigned int y = 0; y < inputImage.getHeight(); ++y)
+  const Common::Image<float> inputImageOFX(&inputImage, Common::eOrientationTopDown);
+  grayImage.create(inputImageOFX.getHeight(), inputImageOFX.getWidth(), cv::DataType<unsigned char>::type);
+  if(settings.isGray)
+  {
+    convertGGG32ToGRAY8(inputImageOFX, grayImage);
+  }
+  else
+  {
+    convertRGB32ToGRAY8(inputImageOFX, grayImage);
+  }
+}
+
+bool findPatternInImage(OFX::Image &inputImage, const PatternSettings &settings, std::vector<cv::Point2f> &checkerPoints, DetectionStats &stats)
+{
+  cv::Mat cvInputGrayImage;
+  convertToPatternImage(inputImage, settings, cvInputGrayImage);
+  return findPatternCoarseToFine(cvInputGrayImage, settings, checkerPoints, stats);
+}
+
+std::string detectionStatsToString(const DetectionStats &stats)
+{
+  std::ostringstream os;
+  os << stats.getNbFrames() << " frames detected, " << stats.nbFound << " found\n"
+     << stats.nbRejectedEarly << " rejected early, "
+     << stats.nbRefined << " refined, "
+     << stats.nbFullResolution << " at full resolution\n";
+  if(stats.getNbFrames() > 0)
   {
-    for(unsigned int x = 0; x < inputImage.getWidth(); ++x)
+    os << "average time : " << 1000.0 * stats.totalTime / stats.getNbFrames() << " ms";
+  }
+  return os.str();
+}
+
+bool solveCalibration(std::vector<std::vector<cv::Point2f> > calibImagePoints,
+                      const CalibrationSettings &settings,
+                      const std::function<bool(const CalibrationProgress&)> &progressCallback,
+                      CalibrationResult &result)
+{
+  std::vector<std::vector<cv::Point3f> > calibObjectPoints;
+  openMVG::calibration::computeObjectPoints(settings.pattern.boardSize, settings.pattern.patternType, settings.squareSize, calibImagePoints, calibObjectPoints);
+
+  // The coefficients unused by the lens model stay at zero
+  CalibrationProblem problem;
+  problem.model = settings.lensModel;
+  problem.isConstant = getConstantParams(settings.lensModel, settings.nbRadialCoef);
+
+  problem.views.resize(calibImagePoints.size());
+  for(std::size_t i = 0; i < calibImagePoints.size(); ++i)
+  {
+    problem.views[i].imagePoints = std::move(calibImagePoints[i]);
+    problem.views[i].objectPoints = std::move(calibObjectPoints[i]);
+  }
+
+  CalibrationProgress progress;
+  progress.nbInputFrames = problem.views.size();
+  progress.nbFrames = problem.views.size();
+  if(!progressCallback(progress))
+    return false;
+
+  result = CalibrationResult();
+  result.camera.model = settings.lensModel;
+  result.camera.width = settings.imageSize.width;
+  result.camera.height = settings.imageSize.height;
+  if(problem.views.empty())
+    return true;
+
+  initializeCalibration(settings.imageSize, problem);
+
+  const std::size_t minFrames = std::max<std::size_t>(settings.minInputFrames, 1);
+  const std::size_t maxSolverIterations = 100;
+  bool canceled = false;
+  auto keepGoing = [&]()
+  {
+    canceled = canceled || !progressCallback(progress);
+    return !canceled;
+  };
+
+  for(;;)
+  {
+    // Solves after a rejection start from the previous camera and poses
+    result.totalAvgErr = refineCalibration(problem, maxSolverIterations, keepGoing);
+    if(canceled)
+      return false;
+
+    result.isCalibrated = std::isfinite(result.totalAvgErr) && problem.camera[0] > 0.0 && problem.camera[1] > 0.0;
+    for(double param : problem.camera)
+      result.isCalibrated = result.isCalibrated && std::isfinite(param);
+
+    ++progress.iteration;
+    progress.nbFrames = problem.views.size();
+    progress.totalAvgErr = result.totalAvgErr;
+    if(!progressCallback(progress))
+      return false;
+
+    if(!result.isCalibrated || result.totalAvgErr <= settings.maxTotalAvgErr || problem.views.size() <= minFrames)
+      break;
+
+    // Reject the 10% worst frames, at least one
+    const std::size_t nbRejected = std::min(std::max<std::size_t>(problem.views.size() / 10, 1), problem.views.size() - minFrames);
+    std::vector<std::size_t> sortedIndexes(problem.views.size());
+    std::iota(sortedIndexes.begin(), sortedIndexes.end(), 0);
+    std::sort(sortedIndexes.begin(), sortedIndexes.end(), [&](std::size_t a, std::size_t b) { return problem.views[a].getError() > problem.views[b].getError(); });
+    std::vector<bool> isRejected(problem.views.size(), false);
+    for(std::size_t i = 0; i < nbRejected; ++i)
+      isRejected[sortedIndexes[i]] = true;
+
+    std::size_t nbKept = 0;
+    for(std::size_t i = 0; i < problem.views.size(); ++i)
     {
-      const float* rgbPtr = inputImage.getPixel(x, y);
-      const float gray = rgbPtr[0];
-      outputImage.at<unsigned char>(y, x) = (unsigned char)(gray * 255.f);
+      if(isRejected[i])
+        continue;
+      if(nbKept != i)
+        problem.views[nbKept] = std::move(problem.views[i]);
+      ++nbKept;
     }
+    problem.views.resize(nbKept);
+    progress.nbRejectedFrames += nbRejected;
   }
+
+  result.camera.params = problem.camera;
+  return true;
+}
+
+std::string calibrationProgressToString(const CalibrationProgress &progress)
+{
+  std::ostringstream os;
+  os << "iteration " << progress.iteration << ", " << progress.nbFrames << " frames";
+  if(progress.nbRejectedFrames > 0)
+  {
+    os << " (" << progress.nbRejectedFrames << " rejected)";
+  }
+  if(progress.totalAvgErr >= 0.0)
+  {
+    os << ", average error : " << progress.totalAvgErr;
+  }
+  return os.str();
 }
 
 openMVG::calibration::Pattern getPatternType(EParamPatternType pattern)
@@ -84,24 +496,5 @@ openMVG::calibration::Pattern getPatternType(EParamPatternType pattern)
   }
 }
 
-void setOutputParams(OFX::DoubleParam *_outputCameraFocalLenght,
-                     OFX::Double2DParam *_outputCameraPrincipalPointOffset,
-                     OFX::DoubleParam *_outputLensDistortionRadialCoef1,
-                     OFX::DoubleParam *_outputLensDistortionRadialCoef2,
-                     OFX::DoubleParam *_outputLensDistortionRadialCoef3,
-                     OFX::DoubleParam *_outputLensDistortionTangentialCoef1,
-                     OFX::DoubleParam *_outputLensDistortionTangentialCoef2,
-                     cv::Mat cameraMatrix,
-                     cv::Mat distCoeffs)
-{
-  _outputCameraFocalLenght->setValue(cameraMatrix.at<double>(0,0));
-  _outputCameraPrincipalPointOffset->setValue(cameraMatrix.at<double>(0,2), cameraMatrix.at<double>(1,2));
-  _outputLensDistortionRadialCoef1->setValue(distCoeffs.at<double>(0));
-  _outputLensDistortionRadialCoef2->setValue(distCoeffs.at<double>(1));
-  _outputLensDistortionRadialCoef3->setValue(distCoeffs.at<double>(4));
-  _outputLensDistortionTangentialCoef1->setValue(distCoeffs.at<double>(2));
-  _outputLensDistortionTangentialCoef2->setValue(distCoeffs.at<double>(3));  
-}
-
 } //namespace LensCalibration
 } //namespace openMVG_ofx
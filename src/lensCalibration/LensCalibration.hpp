@@ -1,5 +1,6 @@
 #pragma once
 #include "LensCalibrationPluginDefinition.hpp"
+#include "LensCalibrationModel.hpp"
 
 #include "../common/Image.hpp"
 
@@ -8,22 +9,79 @@
 
 #include <opencv2/core/mat.hpp>
 
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
 namespace openMVG_ofx {
 namespace LensCalibration {
 
-/**
- * @brief convert a rgb OFX image to a rgb MVG image
- * @param[in] inputImageOFX
- * @param[out] outputImageMVG
- */
-void convertRGBImage(const Common::Image<float>& inputImageOFX, openMVG::image::Image<openMVG::image::RGBfColor>& outputImageMVG);
+//PatternSettings structure for the calibration pattern detection
+struct PatternSettings
+{
+  openMVG::calibration::Pattern patternType = openMVG::calibration::CHESSBOARD;
+  cv::Size boardSize;
+  bool isGray = false;
+  std::size_t detectionMaxSize = 0; //chessboards are searched on a downscaled image first, 0 to disable
+};
 
-/**
- * @brief convert a rgb MVG image to a rgb OFX image
- * @param[in] inputImageMVG
- * @param[out] outputImageOFX
- */
-void convertRGBImage(const openMVG::image::Image<openMVG::image::RGBfColor>& inputImageMVG, Common::Image<float>& outputImageOFX);
+//DetectionStats structure for the pattern detection counters
+struct DetectionStats
+{
+  std::size_t nbRejectedEarly = 0;  //no board on the downscaled image
+  std::size_t nbRefined = 0;        //found on the downscaled image, refined at full resolution
+  std::size_t nbFullResolution = 0; //searched at full resolution
+  std::size_t nbFound = 0;
+  double totalTime = 0.0;           //in seconds
+
+  DetectionStats& operator+=(const DetectionStats &other)
+  {
+    nbRejectedEarly += other.nbRejectedEarly;
+    nbRefined += other.nbRefined;
+    nbFullResolution += other.nbFullResolution;
+    nbFound += other.nbFound;
+    totalTime += other.totalTime;
+    return *this;
+  }
+
+  std::size_t getNbFrames() const
+  {
+    return nbRejectedEarly + nbRefined + nbFullResolution;
+  }
+};
+
+//CalibrationSettings structure for the calibration solve, read from the parameters
+struct CalibrationSettings
+{
+  PatternSettings pattern;
+  cv::Size imageSize;
+  double squareSize = 1.0;
+  EParamLensModel lensModel = eParamLensModelRadialK3;
+  std::size_t nbRadialCoef = 3;
+  std::size_t maxCalibFrames = 100;
+  std::size_t calibGridSize = 10;
+  std::size_t minInputFrames = 10;
+  double maxTotalAvgErr = 0.1;
+};
+
+//CalibrationProgress structure for the state of a running calibration
+struct CalibrationProgress
+{
+  std::size_t iteration = 0;        //solves done
+  std::size_t nbInputFrames = 0;    //frames selected for the calibration
+  std::size_t nbFrames = 0;         //frames used by the last solve
+  std::size_t nbRejectedFrames = 0;
+  double totalAvgErr = -1.0;        //negative before the first solve
+};
+
+//CalibrationResult structure for the solved camera
+struct CalibrationResult
+{
+  bool isCalibrated = false;
+  double totalAvgErr = 0.0;
+  LensCamera camera;
+};
 
 /**
    * @brief convert a (matrix) 32 bits rgb image to a gray (unsigned char) 8 bits image
@@ -39,6 +97,121 @@ void convertRGB32ToGRAY8(const Common::Image<float>& inputImage, cv::Mat& output
    */
 void convertGGG32ToGRAY8(const Common::Image<float>& inputImage, cv::Mat& outputImage);
 
+/**
+ * @brief Get the source region needed to undistort a window of the output image
+ * The distortion is sampled on the window border and on a grid inside the window.
+ * @param[in] camera - at the frame resolution
+ * @param[in] frame - source frame, in pixels
+ * @param[in] window - output window, in pixels
+ * @return the source region, clipped to the frame
+ */
+OfxRectI getUndistortSourceRegion(const LensCamera &camera,
+                                  const OfxRectI &frame,
+                                  const OfxRectI &window);
+
+/**
+ * @brief Undistort a window of the output image
+ * Output pixels are sampled with a bilinear interpolation in the source image
+ * through the shared remap table of the lens model, alpha included. Pixels sampled
+ * outside of the source image are transparent black. Doesn't call the host,
+ * windows can be rendered in parallel.
+ * @param[in] camera - at the frame resolution
+ * @param[in] frame - source frame, in pixels
+ * @param[in] srcImage - RGBA, covering getUndistortSourceRegion of the window
+ * @param[in] window - output window, in pixels
+ * @param[out] dstImage - RGBA, covering the window
+ */
+void undistortWindow(const LensCamera &camera,
+                     const OfxRectI &frame,
+                     const OFX::Image &srcImage,
+                     const OfxRectI &window,
+                     OFX::Image &dstImage);
+
+/**
+ * @brief Compare an undistorted window with a reference computed without the remap table
+ * Only used for debugging. The Radial K3 reference is openMVG UndistortImage, the other
+ * models evaluate the distortion in double precision for each pixel.
+ * @param[in] camera - at the frame resolution
+ * @param[in] srcImage - RGBA
+ * @param[in] window - in pixels
+ * @param[in] dstImage - result of undistortWindow
+ * @return the max difference on the RGB channels, -1 if srcImage isn't the whole frame
+ */
+double compareUndistortWindow(const LensCamera &camera,
+                              const OFX::Image &srcImage,
+                              const OfxRectI &window,
+                              const OFX::Image &dstImage);
+
+/**
+ * @brief Copy a window of an image
+ * @param[in] srcImage - covering the window
+ * @param[in] window - in pixels
+ * @param[out] dstImage - covering the window, same components as srcImage
+ */
+void copyWindow(const OFX::Image &srcImage, const OfxRectI &window, OFX::Image &dstImage);
+
+/**
+ * @brief Detect the calibration pattern in a gray image, coarse to fine
+ * Chessboards are searched on a downscaled image first, frames without board
+ * are rejected there. The corners found are refined at full resolution, in the
+ * board region only. Other patterns are searched at full resolution.
+ * @param[in] grayImage
+ * @param[in] settings
+ * @param[out] checkerPoints
+ * @param[in,out] stats - the detection is counted
+ * @return true if the pattern is found
+ */
+bool findPatternCoarseToFine(const cv::Mat &grayImage, const PatternSettings &settings, std::vector<cv::Point2f> &checkerPoints, DetectionStats &stats);
+
+/**
+ * @brief Convert a RGBA image to the 8-bit gray image searched for the pattern
+ * Doesn't call the host, the input image can be released once converted.
+ * @param[in] inputImage - the whole frame
+ * @param[in] settings
+ * @param[out] grayImage - top-down
+ */
+void convertToPatternImage(OFX::Image &inputImage, const PatternSettings &settings, cv::Mat &grayImage);
+
+/**
+ * @brief Detect the calibration pattern in a RGBA image
+ * Doesn't call the host, can be used from a worker thread.
+ * @param[in] inputImage - the whole frame
+ * @param[in] settings
+ * @param[out] checkerPoints - top-down image coordinates
+ * @param[in,out] stats - the detection is counted
+ * @return true if the pattern is found
+ */
+bool findPatternInImage(OFX::Image &inputImage, const PatternSettings &settings, std::vector<cv::Point2f> &checkerPoints, DetectionStats &stats);
+
+/**
+ * @brief Get a readable summary of the detection counters
+ * @param[in] stats
+ */
+std::string detectionStatsToString(const DetectionStats &stats);
+
+/**
+ * @brief Calibrate the lens from the pattern detections of the selected frames
+ * The camera is solved and the frames with the largest reprojection error are
+ * rejected until the error is below the limit or Min Input Frames is reached.
+ * Each solve after a rejection starts from the previous camera and poses.
+ * Doesn't call the host, can be used from a worker thread.
+ * @param[in] calibImagePoints - corners of the frames selected by selectCalibrationFrames
+ * @param[in] settings
+ * @param[in] progressCallback - called after each solve, returns false to cancel
+ * @param[out] result - the last solve
+ * @return false if canceled
+ */
+bool solveCalibration(std::vector<std::vector<cv::Point2f> > calibImagePoints,
+                      const CalibrationSettings &settings,
+                      const std::function<bool(const CalibrationProgress&)> &progressCallback,
+                      CalibrationResult &result);
+
+/**
+ * @brief Get a readable summary of a calibration progress
+ * @param[in] progress
+ */
+std::string calibrationProgressToString(const CalibrationProgress &progress);
+
 /**
  * @brief get openMVG pattern type enum from Plugin display choice enum
  * @param[in] pattern
@@ -46,30 +219,6 @@ void convertGGG32ToGRAY8(const Common::Image<float>& inputImage, cv::Mat& output
  */
 openMVG::calibration::Pattern getPatternType(EParamPatternType pattern);
 
-/**
- * @brief Set intrinsic values and distortion coefficients into OFX parameters
- * @param[in] _outputFlags
- * @param[in] _outputCameraFocalLenght
- * @param[in] _outputCameraPrincipalPointOffset
- * @param[in] _outputLensDistortionRadialCoef1
- * @param[in] _outputLensDistortionRadialCoef2
- * @param[in] _outputLensDistortionRadialCoef3
- * @param[in] _outputLensDistortionTangentialCoef1
- * @param[in] _outputLensDistortionTangentialCoef2
- * @param[in] cvCalibFlags
- * @param[in] cameraMatrix
- * @param[in] distCoeffs
- */
-void setOutputParams(OFX::DoubleParam *_outputCameraFocalLenght,
-                     OFX::Double2DParam *_outputCameraPrincipalPointOffset,
-                     OFX::DoubleParam *_outputLensDistortionRadialCoef1,
-                     OFX::DoubleParam *_outputLensDistortionRadialCoef2,
-                     OFX::DoubleParam *_outputLensDistortionRadialCoef3,
-                     OFX::DoubleParam *_outputLensDistortionTangentialCoef1,
-                     OFX::DoubleParam *_outputLensDistortionTangentialCoef2,
-                     cv::Mat cameraMatrix,
-                     cv::Mat distCoeffs);
-  
 } //namespace LensCalibration
 } //namespace openMVG_ofx
 
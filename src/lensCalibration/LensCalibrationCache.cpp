@@ -0,0 +1,136 @@
+#include "LensCalibrationCache.hpp"
+#include "../common/Cache.hpp"
+
+#include <boost/filesystem/operations.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace openMVG_ofx {
+namespace LensCalibration {
+
+namespace {
+
+const char kCacheFileMagic[8] = {'O', 'F', 'X', 'M', 'V', 'G', 'L', 'D'};
+const std::uint32_t kCacheFileVersion = 1;
+const std::size_t kCacheFileHeaderSize = sizeof(kCacheFileMagic) + sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+//Record : time, found flag, number of points, then x y floats per point
+const std::size_t kRecordHeaderSize = sizeof(double) + sizeof(std::uint8_t) + sizeof(std::uint32_t);
+
+template<typename T>
+void readValue(const char *&buffer, T &value)
+{
+  std::memcpy(&value, buffer, sizeof(T));
+  buffer += sizeof(T);
+}
+
+template<typename T>
+void writeValue(std::string &buffer, const T &value)
+{
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+} //namespace
+
+bool loadDetections(const std::string &filePath,
+                    std::uint64_t key,
+                    std::map<OfxTime, std::vector<cv::Point2f> > &checkerPerFrame,
+                    std::set<OfxTime> &notFoundFrames)
+{
+  std::ifstream file(filePath.c_str(), std::ios::binary);
+  if(!file)
+  {
+    return false;
+  }
+  const std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+  if(content.size() < kCacheFileHeaderSize || std::memcmp(content.data(), kCacheFileMagic, sizeof(kCacheFileMagic)) != 0)
+  {
+    std::cerr << "[LensCalibration] Invalid detection cache file " << filePath << std::endl;
+    return false;
+  }
+
+  const char *buffer = content.data() + sizeof(kCacheFileMagic);
+  const char *end = content.data() + content.size();
+  std::uint32_t version;
+  std::uint64_t fileKey;
+  readValue(buffer, version);
+  readValue(buffer, fileKey);
+  if(version != kCacheFileVersion || fileKey != key)
+  {
+    return false;
+  }
+
+  while(static_cast<std::size_t>(end - buffer) >= kRecordHeaderSize)
+  {
+    double time;
+    std::uint8_t found;
+    std::uint32_t nbPoints;
+    readValue(buffer, time);
+    readValue(buffer, found);
+    readValue(buffer, nbPoints);
+
+    if(static_cast<std::size_t>(end - buffer) < nbPoints * 2 * sizeof(float))
+    {
+      //Interrupted write
+      break;
+    }
+
+    if(!found)
+    {
+      checkerPerFrame.erase(time);
+      notFoundFrames.insert(time);
+      buffer += nbPoints * 2 * sizeof(float);
+      continue;
+    }
+
+    std::vector<cv::Point2f> &checkerPoints = checkerPerFrame[time];
+    checkerPoints.resize(nbPoints);
+    for(cv::Point2f &point : checkerPoints)
+    {
+      readValue(buffer, point.x);
+      readValue(buffer, point.y);
+    }
+    notFoundFrames.erase(time);
+  }
+  Common::touchCacheFile(filePath);
+  return true;
+}
+
+bool appendDetection(const std::string &filePath,
+                     std::uint64_t key,
+                     OfxTime time,
+                     bool found,
+                     const std::vector<cv::Point2f> &checkerPoints)
+{
+  boost::system::error_code error;
+  const bool isNewFile = !boost::filesystem::exists(filePath, error) || boost::filesystem::file_size(filePath, error) == 0;
+
+  std::string buffer;
+  if(isNewFile)
+  {
+    buffer.append(kCacheFileMagic, sizeof(kCacheFileMagic));
+    writeValue(buffer, kCacheFileVersion);
+    writeValue(buffer, key);
+  }
+
+  const std::uint32_t nbPoints = found ? checkerPoints.size() : 0;
+  writeValue(buffer, static_cast<double>(time));
+  writeValue(buffer, static_cast<std::uint8_t>(found));
+  writeValue(buffer, nbPoints);
+  for(std::size_t i = 0; i < nbPoints; ++i)
+  {
+    writeValue(buffer, checkerPoints[i].x);
+    writeValue(buffer, checkerPoints[i].y);
+  }
+
+  std::ofstream file(filePath.c_str(), std::ios::binary | std::ios::app);
+  file.write(buffer.data(), buffer.size());
+  return static_cast<bool>(file);
+}
+
+} //namespace LensCalibration
+} //namespace openMVG_ofx
@@ -0,0 +1,47 @@
+#pragma once
+#include "ofxsImageEffect.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace openMVG_ofx {
+namespace LensCalibration {
+
+/**
+ * @brief Read the pattern detections of a cache file
+ * The file is a header followed by one record per detected frame, a truncated
+ * last record is ignored.
+ * @param[in] filePath
+ * @param[in] key - detection settings key, the file is ignored if it has another key
+ * @param[out] checkerPerFrame - frames with a pattern
+ * @param[out] notFoundFrames - frames without pattern
+ * @return false if the file doesn't exist or can't be used
+ */
+bool loadDetections(const std::string &filePath,
+                    std::uint64_t key,
+                    std::map<OfxTime, std::vector<cv::Point2f> > &checkerPerFrame,
+                    std::set<OfxTime> &notFoundFrames);
+
+/**
+ * @brief Append the pattern detection of a frame to a cache file
+ * The file is created if needed.
+ * @param[in] filePath
+ * @param[in] key - detection settings key
+ * @param[in] time
+ * @param[in] found
+ * @param[in] checkerPoints
+ * @return false if the file can't be written
+ */
+bool appendDetection(const std::string &filePath,
+                     std::uint64_t key,
+                     OfxTime time,
+                     bool found,
+                     const std::vector<cv::Point2f> &checkerPoints);
+
+} //namespace LensCalibration
+} //namespace openMVG_ofx
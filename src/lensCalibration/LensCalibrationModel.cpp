@@ -0,0 +1,254 @@
+#include "LensCalibrationModel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace openMVG_ofx {
+namespace LensCalibration {
+
+namespace {
+
+const std::size_t kNbDistortionParams = kNbCameraParams - 4;
+
+typedef Eigen::Matrix<double, 2, 2> DistortionPointJacobian;
+typedef Eigen::Matrix<double, 2, kNbDistortionParams> DistortionJacobian;
+
+/**
+ * @brief Brown-Conrady distortion with a rational radial factor, as OpenCV
+ * Radial K3 and Brown are the same model with less coefficients.
+ */
+void distortRational(const double *coefs, double x, double y, openMVG::Vec2 &distorted,
+                     DistortionPointJacobian *dPoint, DistortionJacobian *dCoefs)
+{
+  const double k1 = coefs[0];
+  const double k2 = coefs[1];
+  const double p1 = coefs[2];
+  const double p2 = coefs[3];
+  const double k3 = coefs[4];
+  const double k4 = coefs[5];
+  const double k5 = coefs[6];
+  const double k6 = coefs[7];
+
+  const double x2 = x * x;
+  const double y2 = y * y;
+  const double xy = x * y;
+  const double r2 = x2 + y2;
+  const double r4 = r2 * r2;
+  const double r6 = r4 * r2;
+  const double invDen = 1.0 / (1.0 + r2 * (k4 + r2 * (k5 + r2 * k6)));
+  const double radial = (1.0 + r2 * (k1 + r2 * (k2 + r2 * k3))) * invDen;
+
+  distorted(0) = x * radial + 2.0 * p1 * xy + p2 * (r2 + 2.0 * x2);
+  distorted(1) = y * radial + p1 * (r2 + 2.0 * y2) + 2.0 * p2 * xy;
+
+  if(dCoefs != nullptr)
+  {
+    DistortionJacobian &d = *dCoefs;
+    const double dRadial[6] = {r2 * invDen, r4 * invDen, r6 * invDen,
+                               -radial * r2 * invDen, -radial * r4 * invDen, -radial * r6 * invDen};
+    const std::size_t radialIndexes[6] = {0, 1, 4, 5, 6, 7};
+    for(std::size_t i = 0; i < 6; ++i)
+    {
+      d(0, radialIndexes[i]) = x * dRadial[i];
+      d(1, radialIndexes[i]) = y * dRadial[i];
+    }
+    d(0, 2) = 2.0 * xy;
+    d(1, 2) = r2 + 2.0 * y2;
+    d(0, 3) = r2 + 2.0 * x2;
+    d(1, 3) = 2.0 * xy;
+  }
+
+  if(dPoint != nullptr)
+  {
+    //Derivative of the radial factor by x, divided by x
+    const double dRadial = 2.0 * ((k1 + r2 * (2.0 * k2 + 3.0 * k3 * r2)) - radial * (k4 + r2 * (2.0 * k5 + 3.0 * k6 * r2))) * invDen;
+    DistortionPointJacobian &d = *dPoint;
+    d(0, 0) = radial + x2 * dRadial + 2.0 * p1 * y + 6.0 * p2 * x;
+    d(0, 1) = xy * dRadial + 2.0 * p1 * x + 2.0 * p2 * y;
+    d(1, 0) = d(0, 1);
+    d(1, 1) = radial + y2 * dRadial + 6.0 * p1 * y + 2.0 * p2 * x;
+  }
+}
+
+/**
+ * @brief Equidistant fisheye distortion, as OpenCV fisheye
+ * The distorted radius is theta (1 + k1 theta^2 + k2 theta^4 + k3 theta^6 + k4 theta^8).
+ */
+void distortFisheye(const double *coefs, double x, double y, openMVG::Vec2 &distorted,
+                    DistortionPointJacobian *dPoint, DistortionJacobian *dCoefs)
+{
+  const double k1 = coefs[0];
+  const double k2 = coefs[1];
+  const double k3 = coefs[2];
+  const double k4 = coefs[3];
+
+  const double r2 = x * x + y * y;
+  const double r = std::sqrt(r2);
+  const double theta = std::atan(r);
+  const double theta2 = theta * theta;
+  const double thetaByR = (r > 1e-12) ? theta / r : 1.0;
+  const double thetaD = theta * (1.0 + theta2 * (k1 + theta2 * (k2 + theta2 * (k3 + theta2 * k4))));
+  const double scale = (r > 1e-12) ? thetaD / r : 1.0;
+
+  distorted(0) = x * scale;
+  distorted(1) = y * scale;
+
+  if(dCoefs != nullptr)
+  {
+    DistortionJacobian &d = *dCoefs;
+    double power = thetaByR * theta2;
+    for(std::size_t i = 0; i < 4; ++i, power *= theta2)
+    {
+      d(0, i) = x * power;
+      d(1, i) = y * power;
+    }
+  }
+
+  if(dPoint != nullptr)
+  {
+    //Derivative of the scale by r, divided by r
+    double dScale;
+    if(r > 1e-4)
+    {
+      const double dThetaD = (1.0 + theta2 * (3.0 * k1 + theta2 * (5.0 * k2 + theta2 * (7.0 * k3 + theta2 * 9.0 * k4)))) / (1.0 + r2);
+      dScale = (dThetaD * r - thetaD) / (r2 * r);
+    }
+    else
+    {
+      dScale = 2.0 * (k1 - 1.0 / 3.0);
+    }
+    DistortionPointJacobian &d = *dPoint;
+    d(0, 0) = scale + x * x * dScale;
+    d(0, 1) = x * y * dScale;
+    d(1, 0) = d(0, 1);
+    d(1, 1) = scale + y * y * dScale;
+  }
+}
+
+} //namespace
+
+openMVG::Vec2 LensCamera::getDistortedPixel(const openMVG::Vec2 &undistorted) const
+{
+  const openMVG::Vec3 point((undistorted(0) - params[2]) / params[0], (undistorted(1) - params[3]) / params[1], 1.0);
+  openMVG::Vec2 pixel;
+  projectPoint(model, params, point, pixel, nullptr, nullptr);
+  return pixel;
+}
+
+void projectPoint(EParamLensModel model,
+                  const CameraParams &params,
+                  const openMVG::Vec3 &point,
+                  openMVG::Vec2 &pixel,
+                  CameraJacobian *dParams,
+                  PointJacobian *dPoint)
+{
+  const double fx = params[0];
+  const double fy = params[1];
+  const double invZ = 1.0 / point(2);
+  const double x = point(0) * invZ;
+  const double y = point(1) * invZ;
+
+  openMVG::Vec2 distorted;
+  DistortionPointJacobian dDistortedPoint;
+  DistortionJacobian dCoefs;
+  DistortionPointJacobian *dDistortedPointPtr = (dPoint != nullptr) ? &dDistortedPoint : nullptr;
+  DistortionJacobian *dCoefsPtr = nullptr;
+  if(dParams != nullptr)
+  {
+    dCoefs.setZero();
+    dCoefsPtr = &dCoefs;
+  }
+
+  switch(model)
+  {
+    case eParamLensModelRadialK3 :
+    case eParamLensModelBrown :
+    case eParamLensModelRational :
+      distortRational(&params[4], x, y, distorted, dDistortedPointPtr, dCoefsPtr);
+      break;
+    case eParamLensModelFisheye :
+      distortFisheye(&params[4], x, y, distorted, dDistortedPointPtr, dCoefsPtr);
+      break;
+    default :
+      throw std::invalid_argument("Unrecognized Lens Model : " + std::to_string(model));
+  }
+
+  pixel(0) = fx * distorted(0) + params[2];
+  pixel(1) = fy * distorted(1) + params[3];
+
+  if(dParams != nullptr)
+  {
+    CameraJacobian &d = *dParams;
+    d.leftCols<4>().setZero();
+    d(0, 0) = distorted(0);
+    d(1, 1) = distorted(1);
+    d(0, 2) = 1.0;
+    d(1, 3) = 1.0;
+    d.block<1, kNbDistortionParams>(0, 4) = fx * dCoefs.row(0);
+    d.block<1, kNbDistortionParams>(1, 4) = fy * dCoefs.row(1);
+  }
+
+  if(dPoint != nullptr)
+  {
+    PointJacobian &d = *dPoint;
+    for(int row = 0; row < 2; ++row)
+    {
+      const double f = (row == 0) ? fx : fy;
+      const double dx = f * dDistortedPoint(row, 0) * invZ;
+      const double dy = f * dDistortedPoint(row, 1) * invZ;
+      d(row, 0) = dx;
+      d(row, 1) = dy;
+      d(row, 2) = -(dx * x + dy * y);
+    }
+  }
+}
+
+std::array<bool, kNbCameraParams> getConstantParams(EParamLensModel model, std::size_t nbRadialCoef)
+{
+  std::array<bool, kNbCameraParams> isConstant;
+  isConstant.fill(true);
+  for(std::size_t i = 0; i < 4; ++i)
+    isConstant[i] = false;
+
+  switch(model)
+  {
+    case eParamLensModelRadialK3 :
+    case eParamLensModelBrown :
+    case eParamLensModelRational :
+    {
+      const std::size_t radialIndexes[6] = {4, 5, 8, 9, 10, 11};
+      const std::size_t maxRadialCoef = (model == eParamLensModelRational) ? 6 : 3;
+      for(std::size_t i = 0; i < std::min(nbRadialCoef, maxRadialCoef); ++i)
+        isConstant[radialIndexes[i]] = false;
+      if(model != eParamLensModelRadialK3)
+      {
+        isConstant[6] = false;
+        isConstant[7] = false;
+      }
+      break;
+    }
+    case eParamLensModelFisheye :
+      for(std::size_t i = 0; i < std::min<std::size_t>(nbRadialCoef, 4); ++i)
+        isConstant[4 + i] = false;
+      break;
+    default :
+      throw std::invalid_argument("Unrecognized Lens Model : " + std::to_string(model));
+  }
+  return isConstant;
+}
+
+std::string getLensModelName(EParamLensModel model)
+{
+  switch(model)
+  {
+    case eParamLensModelRadialK3 : return "lensCalibrationRadialK3";
+    case eParamLensModelBrown : return "lensCalibrationBrown";
+    case eParamLensModelRational : return "lensCalibrationRational";
+    case eParamLensModelFisheye : return "lensCalibrationFisheye";
+    default : throw std::invalid_argument("Unrecognized Lens Model : " + std::to_string(model));
+  }
+}
+
+} //namespace LensCalibration
+} //namespace openMVG_ofx
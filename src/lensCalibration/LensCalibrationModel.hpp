@@ -0,0 +1,71 @@
+#pragma once
+#include "LensCalibrationPluginDefinition.hpp"
+
+#include <openMVG/numeric/numeric.h>
+
+#include <array>
+#include <cstddef>
+#include <string>
+
+namespace openMVG_ofx {
+namespace LensCalibration {
+
+/**
+ * Camera parameters : fx, fy, cx, cy, then the distortion coefficients.
+ * Radial K3, Brown and Rational share the OpenCV order k1, k2, p1, p2, k3, k4, k5, k6.
+ * Fisheye uses k1, k2, k3, k4, the other coefficients are zero.
+ */
+const std::size_t kNbCameraParams = 12;
+
+typedef std::array<double, kNbCameraParams> CameraParams;
+typedef Eigen::Matrix<double, 2, kNbCameraParams> CameraJacobian;
+typedef Eigen::Matrix<double, 2, 3> PointJacobian;
+
+//LensCamera structure for a calibrated camera and its lens model
+struct LensCamera
+{
+  EParamLensModel model = eParamLensModelRadialK3;
+  std::size_t width = 0;
+  std::size_t height = 0;
+  CameraParams params = CameraParams();
+
+  /**
+   * @brief Get the pixel of the distorted image seen by an undistorted pixel
+   * The undistorted image has the same focal and principal point.
+   * @param[in] undistorted - top-down image coordinates
+   */
+  openMVG::Vec2 getDistortedPixel(const openMVG::Vec2 &undistorted) const;
+};
+
+/**
+ * @brief Project a point of the camera frame with a lens model
+ * @param[in] model
+ * @param[in] params
+ * @param[in] point - in the camera frame, in front of the camera
+ * @param[out] pixel
+ * @param[out] dParams - derivatives by the camera parameters, if not null
+ * @param[out] dPoint - derivatives by the point, if not null
+ */
+void projectPoint(EParamLensModel model,
+                  const CameraParams &params,
+                  const openMVG::Vec3 &point,
+                  openMVG::Vec2 &pixel,
+                  CameraJacobian *dParams,
+                  PointJacobian *dPoint);
+
+/**
+ * @brief Get the camera parameters left constant by the calibration
+ * @param[in] model
+ * @param[in] nbRadialCoef - number of radial coefficients solved, from k1
+ * @return true for the constant parameters
+ */
+std::array<bool, kNbCameraParams> getConstantParams(EParamLensModel model, std::size_t nbRadialCoef);
+
+/**
+ * @brief Get the lens model name, used as undistortion table key
+ * @param[in] model
+ */
+std::string getLensModelName(EParamLensModel model);
+
+} //namespace LensCalibration
+} //namespace openMVG_ofx
@@ -1,12 +1,13 @@
 #include "LensCalibrationPlugin.hpp"
 #include "LensCalibration.hpp"
+#include "LensCalibrationCache.hpp"
+#include "LensCalibrationSelection.hpp"
+#include "../common/Cache.hpp"
 #include "../common/Image.hpp"
+#include "../common/ThreadPool.hpp"
 
 #include <openMVG/calibration/patternDetect.hpp>
-#include <openMVG/calibration/bestImages.hpp>
-#include <openMVG/calibration/calibration.hpp>
 #include <openMVG/calibration/exportData.hpp>
-#include <openMVG/cameras/Camera_undistort_image.hpp>
 #include <openMVG/image/pixel_types.hpp>
 
 #include <opencv2/opencv.hpp>
@@ -14,6 +15,14 @@
 
 #include <map>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <future>
+#include <memory>
+#include <set>
+#include <string>
 #include <vector>
 #include <stdio.h>
 #include <cassert>
@@ -24,6 +33,27 @@
 namespace openMVG_ofx {
 namespace LensCalibration {
 
+namespace {
+
+// Detections file prefixes of the living instances, a copied node must not append to the same files
+std::mutex detectionPrefixesMutex;
+std::set<std::string> detectionPrefixes;
+
+bool claimDetectionPrefix(const std::string &prefix)
+{
+  if(prefix.empty())
+    return false;
+  std::lock_guard<std::mutex> guard(detectionPrefixesMutex);
+  return detectionPrefixes.insert(prefix).second;
+}
+
+void releaseDetectionPrefix(const std::string &prefix)
+{
+  std::lock_guard<std::mutex> guard(detectionPrefixesMutex);
+  detectionPrefixes.erase(prefix);
+}
+
+} //namespace
 
 LensCalibrationPlugin::LensCalibrationPlugin(OfxImageEffectHandle handle)
   : OFX::ImageEffect(handle)
@@ -31,16 +61,38 @@ LensCalibrationPlugin::LensCalibrationPlugin(OfxImageEffectHandle handle)
   _outputParams.push_back(_outputIsCalibrated);
   _outputParams.push_back(_outputAvgReprojErr);
   _outputParams.push_back(_outputCameraFocalLenght);
+  _outputParams.push_back(_outputCameraFocalRatio);
   _outputParams.push_back(_outputCameraPrincipalPointOffset);
+  _outputParams.push_back(_outputLensModel);
   _outputParams.push_back(_outputLensDistortionRadialCoef1);
   _outputParams.push_back(_outputLensDistortionRadialCoef2);
   _outputParams.push_back(_outputLensDistortionRadialCoef3);
+  _outputParams.push_back(_outputLensDistortionRadialCoef4);
+  _outputParams.push_back(_outputLensDistortionRadialCoef5);
+  _outputParams.push_back(_outputLensDistortionRadialCoef6);
   _outputParams.push_back(_outputLensDistortionTangentialCoef1);
   _outputParams.push_back(_outputLensDistortionTangentialCoef2);
+
+  // New or copied instance, create its own detections file prefix outside of the renders
+  if(!claimDetectionPrefix(_detectionCacheFile->getValue()))
+    createDetectionCacheFile();
+}
+
+LensCalibrationPlugin::~LensCalibrationPlugin()
+{
+  releaseDetectionPrefix(_detectionCacheFile->getValue());
+}
+
+void LensCalibrationPlugin::createDetectionCacheFile()
+{
+  const std::string prefix = Common::createCacheFilePath("lensdetect", "");
+  claimDetectionPrefix(prefix);
+  _detectionCacheFile->setValue(prefix);
 }
 
 void LensCalibrationPlugin::syncPrivateData()
 {
+  // Detections are appended to their file as soon as they are done
   std::cout << "LensCalibrationPlugin::syncPrivateData" << std::endl;
 }
 
@@ -68,177 +120,532 @@ void LensCalibrationPlugin::render(const OFX::RenderArguments &args)
     std::cout << "render : abort" << std::endl;
     return;
   }
-  OFX::Image *inputPtr = _srcClip->fetchImage(args.time);
-  if(inputPtr == NULL)
+  std::unique_ptr<OFX::Image> inputPtr(_srcClip->fetchImage(args.time));
+  if(!inputPtr)
   {
     std::cout << "Input image is NULL" << std::endl;
     return;
   }
-  const Common::Image<float> inputImageOFX(inputPtr, Common::eOrientationTopDown);
+  std::unique_ptr<OFX::Image> outputPtr(_dstClip->fetchImage(args.time));
+  if(!outputPtr)
+  {
+    std::cout << "Output image is NULL" << std::endl;
+    return;
+  }
 
   if(_outputIsCalibrated->getValue())
   {
-    OfxPointD principalPoint = _outputCameraPrincipalPointOffset->getValue();
-    // Lens already calibrated, directly undistort the input image
-    openMVG::cameras::Pinhole_Intrinsic_Radial_K3 camera(inputImageOFX.getWidth(),
-                                                         inputImageOFX.getHeight(),
-                                                         _outputCameraFocalLenght->getValue(),
-                                                         principalPoint.x,
-                                                         principalPoint.y,
-                                                         _outputLensDistortionRadialCoef1->getValue(),
-                                                         _outputLensDistortionRadialCoef2->getValue(),
-                                                         _outputLensDistortionRadialCoef3->getValue());
-
-    openMVG::image::Image<openMVG::image::RGBfColor> inputImageMVG;
-    convertRGBImage(inputImageOFX, inputImageMVG);
-    openMVG::image::Image<openMVG::image::RGBfColor> outputImageMVG;
-    openMVG::cameras::UndistortImage(inputImageMVG, &camera, outputImageMVG);
-    
-    OFX::Image *outputPtr = _dstClip->fetchImage(args.time);
-    if(outputPtr == NULL)
+    // Lens already calibrated, directly undistort the render window
+    const OfxRectI &frame = inputPtr->getRegionOfDefinition();
+    const LensCamera camera = getCalibratedCamera(frame.x2 - frame.x1, frame.y2 - frame.y1);
+    undistortWindow(camera, frame, *inputPtr, args.renderWindow, *outputPtr);
+
+    if(_debugEnable->getValue())
     {
-      std::cout << "Output image is NULL" << std::endl;
-      return;
+      const double maxDifference = compareUndistortWindow(camera, *inputPtr, args.renderWindow, *outputPtr);
+      if(maxDifference >= 0.0)
+        std::cout << "render : [debug] undistort max difference with the reference : " << maxDifference << std::endl;
     }
-    Common::Image<float> outputImageOFX(outputPtr, Common::eOrientationTopDown);
-    convertRGBImage(inputImageMVG, outputImageOFX);
   }
   else
   {
-    bool found = false;
-    // Detect checkerboard for calibration
-    if(checkerPerFrame.count(args.time) == 0) // if not already extracted
+    // The input is passed through, the region of interest is the whole frame
+    detectPattern(args.time, inputPtr.get());
+    copyWindow(*inputPtr, args.renderWindow, *outputPtr);
+    // TODO: export number of images for calibration to a user parameter
+  }
+}
+
+void LensCalibrationPlugin::getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois)
+{
+  const OfxRectD srcRoD = _srcClip->getRegionOfDefinition(args.time);
+
+  if(!_outputIsCalibrated->getValue())
+  {
+    // The pattern detection needs the whole frame
+    rois.setRegionOfInterest(*_srcClip, srcRoD);
+    return;
+  }
+
+  //No multi-resolution, canonical coordinates are pixels
+  OfxRectI frame;
+  frame.x1 = static_cast<int>(std::floor(srcRoD.x1));
+  frame.y1 = static_cast<int>(std::floor(srcRoD.y1));
+  frame.x2 = static_cast<int>(std::ceil(srcRoD.x2));
+  frame.y2 = static_cast<int>(std::ceil(srcRoD.y2));
+
+  OfxRectI window;
+  window.x1 = static_cast<int>(std::floor(args.regionOfInterest.x1));
+  window.y1 = static_cast<int>(std::floor(args.regionOfInterest.y1));
+  window.x2 = static_cast<int>(std::ceil(args.regionOfInterest.x2));
+  window.y2 = static_cast<int>(std::ceil(args.regionOfInterest.y2));
+
+  const LensCamera camera = getCalibratedCamera(frame.x2 - frame.x1, frame.y2 - frame.y1);
+  const OfxRectI region = getUndistortSourceRegion(camera, frame, window);
+
+  OfxRectD srcRoI;
+  srcRoI.x1 = region.x1;
+  srcRoI.y1 = region.y1;
+  srcRoI.x2 = region.x2;
+  srcRoI.y2 = region.y2;
+  rois.setRegionOfInterest(*_srcClip, srcRoI);
+}
+
+LensCamera LensCalibrationPlugin::getCalibratedCamera(std::size_t width, std::size_t height)
+{
+  const OfxPointD principalPoint = _outputCameraPrincipalPointOffset->getValue();
+  const double focalLength = _outputCameraFocalLenght->getValue();
+
+  LensCamera camera;
+  camera.model = EParamLensModel(_outputLensModel->getValue());
+  camera.width = width;
+  camera.height = height;
+  camera.params[0] = focalLength;
+  camera.params[1] = focalLength * _outputCameraFocalRatio->getValue();
+  camera.params[2] = principalPoint.x;
+  camera.params[3] = principalPoint.y;
+
+  switch(camera.model)
+  {
+    case eParamLensModelRational :
+      camera.params[9] = _outputLensDistortionRadialCoef4->getValue();
+      camera.params[10] = _outputLensDistortionRadialCoef5->getValue();
+      camera.params[11] = _outputLensDistortionRadialCoef6->getValue();
+      // fall through
+    case eParamLensModelBrown :
+      camera.params[6] = _outputLensDistortionTangentialCoef1->getValue();
+      camera.params[7] = _outputLensDistortionTangentialCoef2->getValue();
+      // fall through
+    case eParamLensModelRadialK3 :
+      camera.params[4] = _outputLensDistortionRadialCoef1->getValue();
+      camera.params[5] = _outputLensDistortionRadialCoef2->getValue();
+      camera.params[8] = _outputLensDistortionRadialCoef3->getValue();
+      break;
+    case eParamLensModelFisheye :
+      camera.params[4] = _outputLensDistortionRadialCoef1->getValue();
+      camera.params[5] = _outputLensDistortionRadialCoef2->getValue();
+      camera.params[6] = _outputLensDistortionRadialCoef3->getValue();
+      camera.params[7] = _outputLensDistortionRadialCoef4->getValue();
+      break;
+    default : throw std::invalid_argument("Unrecognized Lens Model : " + std::to_string(camera.model));
+  }
+  return camera;
+}
+
+void LensCalibrationPlugin::setCalibratedCamera(const LensCamera &camera)
+{
+  const CameraParams &params = camera.params;
+  _outputCameraFocalLenght->setValue(params[0]);
+  _outputCameraFocalRatio->setValue((params[0] != 0.0) ? params[1] / params[0] : 1.0);
+  _outputCameraPrincipalPointOffset->setValue(params[2], params[3]);
+  _outputLensModel->setValue(camera.model);
+
+  if(camera.model == eParamLensModelFisheye)
+  {
+    _outputLensDistortionRadialCoef1->setValue(params[4]);
+    _outputLensDistortionRadialCoef2->setValue(params[5]);
+    _outputLensDistortionRadialCoef3->setValue(params[6]);
+    _outputLensDistortionRadialCoef4->setValue(params[7]);
+    _outputLensDistortionRadialCoef5->setValue(0.0);
+    _outputLensDistortionRadialCoef6->setValue(0.0);
+    _outputLensDistortionTangentialCoef1->setValue(0.0);
+    _outputLensDistortionTangentialCoef2->setValue(0.0);
+    return;
+  }
+  _outputLensDistortionRadialCoef1->setValue(params[4]);
+  _outputLensDistortionRadialCoef2->setValue(params[5]);
+  _outputLensDistortionRadialCoef3->setValue(params[8]);
+  _outputLensDistortionRadialCoef4->setValue(params[9]);
+  _outputLensDistortionRadialCoef5->setValue(params[10]);
+  _outputLensDistortionRadialCoef6->setValue(params[11]);
+  _outputLensDistortionTangentialCoef1->setValue(params[6]);
+  _outputLensDistortionTangentialCoef2->setValue(params[7]);
+}
+
+PatternSettings LensCalibrationPlugin::getPatternSettings()
+{
+  PatternSettings settings;
+  const OfxPointI patternSize(_inputPatternSize->getValue());
+  settings.patternType = getPatternType(EParamPatternType(_inputPatternType->getValue()));
+  settings.boardSize = cv::Size(patternSize.x, patternSize.y);
+  settings.isGray = _inputImageIsGray->getValue();
+  settings.detectionMaxSize = _inputDetectionMaxSize->getValue();
+  return settings;
+}
+
+std::string LensCalibrationPlugin::getDetectionsFilePath(std::uint64_t key)
+{
+  Common::Hasher hasher;
+  hasher.updateValue(key);
+  return _detectionCacheFile->getValue() + "_" + hasher.toString() + ".bin";
+}
+
+std::uint64_t LensCalibrationPlugin::getDetectionsKey()
+{
+  const PatternSettings settings = getPatternSettings();
+  const OfxRangeD range = _srcClip->getFrameRange();
+  const OfxRectD rod = _srcClip->getRegionOfDefinition(range.min);
+
+  Common::Hasher hasher;
+  hasher.updateValue(static_cast<int>(settings.patternType));
+  hasher.updateValue(settings.boardSize.width);
+  hasher.updateValue(settings.boardSize.height);
+  hasher.updateValue(settings.isGray);
+  hasher.updateValue(settings.detectionMaxSize);
+  hasher.updateValue(range.min);
+  hasher.updateValue(range.max);
+  hasher.updateValue(rod.x1);
+  hasher.updateValue(rod.y1);
+  hasher.updateValue(rod.x2);
+  hasher.updateValue(rod.y2);
+  return hasher.value();
+}
+
+void LensCalibrationPlugin::ensureDetectionsLoaded()
+{
+  const std::uint64_t key = getDetectionsKey();
+
+  std::unique_lock<std::mutex> lock(_checkerMutex);
+  if(_isDetectionsLoaded && _loadedDetectionsKey == key)
+  {
+    return;
+  }
+  // Detections in progress belong to the previous key
+  _checkerCondition.wait(lock, [&]() { return _detectingFrames.empty(); });
+
+  checkerPerFrame.clear();
+  _checkerNotFoundFrames.clear();
+  _detectionStats = DetectionStats();
+  _debugDetectionStats->setValue(detectionStatsToString(_detectionStats));
+  _loadedDetectionsKey = key;
+  _isDetectionsLoaded = true;
+
+  const std::string filePath = getDetectionsFilePath(key);
+  if(!loadDetections(filePath, key, checkerPerFrame, _checkerNotFoundFrames))
+  {
+    return;
+  }
+  std::cout << "Detections loaded from " << filePath << " : checker found on " << checkerPerFrame.size()
+            << " frames, not found on " << _checkerNotFoundFrames.size() << " frames." << std::endl;
+
+  if(!checkerPerFrame.empty())
+  {
+    // The key holds the clip size, all the detections have the current size
+    const OfxRectD rod = _srcClip->getRegionOfDefinition(_srcClip->getFrameRange().min);
+    _inputImageSize->setValue(static_cast<int>(rod.x2 - rod.x1), static_cast<int>(rod.y2 - rod.y1));
+  }
+}
+
+bool LensCalibrationPlugin::beginDetection(OfxTime time, const OfxRectI &frame)
+{
+  ensureDetectionsLoaded();
+
+  // Tiles of the same frame wait for a single detection
+  std::unique_lock<std::mutex> lock(_checkerMutex);
+  _checkerCondition.wait(lock, [&]() { return _detectingFrames.count(time) == 0; });
+
+  if(checkerPerFrame.count(time) != 0 || _checkerNotFoundFrames.count(time) != 0) // if already extracted
+  {
+    return false;
+  }
+
+  const OfxPointI imageSizeParamValue(_inputImageSize->getValue());
+  if(checkerPerFrame.empty() && _detectingFrames.empty())
+  {
+    // If no checkerboard collected, initialize with the current image size
+    _inputImageSize->setValue(frame.x2 - frame.x1, frame.y2 - frame.y1);
+  }
+  else if(imageSizeParamValue.x != (frame.x2 - frame.x1) || imageSizeParamValue.y != (frame.y2 - frame.y1))
+  {
+    std::cerr << "All images don't have the same size." << std::endl;
+    return false;
+  }
+  _detectingFrames.insert(time);
+  return true;
+}
+
+void LensCalibrationPlugin::endDetection(OfxTime time, bool found, const std::vector<cv::Point2f> &checkerPoints, const DetectionStats &stats)
+{
+  std::lock_guard<std::mutex> guard(_checkerMutex);
+  _detectionStats += stats;
+  _debugDetectionStats->setValue(detectionStatsToString(_detectionStats));
+
+  if(_isDetectionsLoaded && !appendDetection(getDetectionsFilePath(_loadedDetectionsKey), _loadedDetectionsKey, time, found, checkerPoints))
+    std::cerr << "Can't write the detection of time " << time << " to the cache." << std::endl;
+
+  if(found)
+  {
+    checkerPerFrame[time] = checkerPoints;
+    std::cout << "Checker found at time " << time << " (" << checkerPoints.size() << " points)." << std::endl;
+  }
+  else
+  {
+    _checkerNotFoundFrames.insert(time);
+    std::cout << "Checker NOT found at time " << time << "." << std::endl;
+  }
+  _detectingFrames.erase(time);
+  _checkerCondition.notify_all();
+}
+
+void LensCalibrationPlugin::cancelDetection(OfxTime time)
+{
+  std::lock_guard<std::mutex> guard(_checkerMutex);
+  _detectingFrames.erase(time);
+  _checkerCondition.notify_all();
+}
+
+void LensCalibrationPlugin::detectPattern(OfxTime time, OFX::Image *inputPtr)
+{
+  if(!beginDetection(time, inputPtr->getRegionOfDefinition()))
+  {
+    return;
+  }
+
+  std::cout << "Detect checkerboard for calibration at frame " << time << std::endl;
+  bool found = false;
+  std::vector<cv::Point2f> checkerPoints;
+  DetectionStats stats;
+  try
+  {
+    found = findPatternInImage(*inputPtr, getPatternSettings(), checkerPoints, stats);
+  }
+  catch(std::exception &e)
+  {
+    std::cerr << "Checker detection failed at time " << time << " : " << e.what() << std::endl;
+    cancelDetection(time);
+    return;
+  }
+  endDetection(time, found, checkerPoints, stats);
+}
+
+void LensCalibrationPlugin::detectAll()
+{
+  const OfxRangeD range = _srcClip->getFrameRange();
+  const int first = static_cast<int>(std::ceil(range.min));
+  const int last = static_cast<int>(std::floor(range.max));
+  if(first > last)
+  {
+    sendMessage(OFX::Message::eMessageError, "lenscalibration.detectall", "The input clip has no frame.");
+    return;
+  }
+
+  // At most Max Frames frames, evenly spaced
+  const std::size_t nbClipFrames = last - first + 1;
+  const std::size_t maxFrames = _inputMaxFrames->getValue();
+  const std::size_t step = (maxFrames == 0) ? 1 : (nbClipFrames + maxFrames - 1) / maxFrames;
+  const std::size_t nbFrames = (nbClipFrames + step - 1) / step;
+
+  //Host calls (image fetch, params) stay on this thread, workers only do the detection.
+  //The input images are converted to gray and released at fetch: jobs in flight only keep 8-bit images.
+  struct DetectJob
+  {
+    OfxTime time;
+    cv::Mat grayImage;
+    std::vector<cv::Point2f> checkerPoints;
+    DetectionStats stats;
+    std::future<bool> found;
+  };
+
+  ensureDetectionsLoaded();
+
+  Common::ThreadPool pool;
+  const std::size_t maxJobsInFlight = 2 * pool.getNbThreads();
+  const PatternSettings settings = getPatternSettings();
+
+  std::deque< std::unique_ptr<DetectJob> > jobs;
+  std::size_t nbFramesDone = 0;
+  bool canceled = false;
+
+  //Wait for the oldest job and store its detection
+  auto commitOldestJob = [&]()
+  {
+    std::unique_ptr<DetectJob> job = std::move(jobs.front());
+    jobs.pop_front();
+    try
     {
-      std::cout << "Detect checkerboard for calibration at frame " << args.time << std::endl;
-      std::cout << "checkerPerFrame.size(): " << checkerPerFrame.size() << std::endl;
-      OfxPointI imageSizeParamValue(_inputImageSize->getValue());
-      OfxPointI imageSizeMVG{static_cast<int>(inputImageOFX.getWidth()), static_cast<int>(inputImageOFX.getHeight())};
-      if(checkerPerFrame.empty())
-        // If no checkerboard collected, initialize with the current image size
-        _inputImageSize->setValue(inputImageOFX.getWidth(), inputImageOFX.getHeight());
-      else if(imageSizeParamValue.x != imageSizeMVG.x || imageSizeParamValue.y != imageSizeMVG.y)
-      {
-        std::cerr << "All images don't have the same size." << std::endl;
-//        throw std::logic_error("All images don't have the same size.");
-        return;
-      }
+      const bool found = job->found.get();
+      endDetection(job->time, found, job->checkerPoints, job->stats);
+    }
+    catch(std::exception &e)
+    {
+      std::cerr << "Checker detection failed at time " << job->time << " : " << e.what() << std::endl;
+      cancelDetection(job->time);
+    }
+    ++nbFramesDone;
+  };
 
-      cv::Mat cvInputGrayImage(inputImageOFX.getHeight(), inputImageOFX.getWidth(), cv::DataType<unsigned char>::type);
-      if(_inputImageIsGray->getValue())
-      {
-        convertGGG32ToGRAY8(inputImageOFX, cvInputGrayImage);
-      }
-      else
+  std::cout << "detectAll : [info] " << nbFrames << " frames from " << first << " to " << last << " on " << pool.getNbThreads() << " threads" << std::endl;
+  progressStart("Pattern detection");
+
+  for(std::size_t i = 0; i < nbFrames && !canceled; ++i)
+  {
+    const OfxTime time = first + i * step;
+
+    std::unique_ptr<DetectJob> job(new DetectJob());
+    job->time = time;
+    std::unique_ptr<OFX::Image> inputPtr(_srcClip->fetchImage(time));
+
+    if(!inputPtr)
+    {
+      std::cerr << "detectAll : [error] can't fetch the input at frame " << time << std::endl;
+      ++nbFramesDone;
+    }
+    else if(!beginDetection(time, inputPtr->getRegionOfDefinition()))
+    {
+      ++nbFramesDone;
+    }
+    else
+    {
+      convertToPatternImage(*inputPtr, settings, job->grayImage);
+      inputPtr.reset();
+
+      DetectJob *jobPtr = job.get();
+      job->found = pool.submit([jobPtr, &settings]()
       {
-        convertRGB32ToGRAY8(inputImageOFX, cvInputGrayImage);
-      }
-
-      OfxPointI p(_inputPatternSize->getValue());
-      cv::Size boardSize(p.x, p.y);
-      std::cout << "inputPatternSize: " << boardSize.width << ", " << boardSize.height << std::endl;
-      EParamPatternType inputPatternType = EParamPatternType(_inputPatternType->getValue());
-      std::cout << "inputPatternType: " << int(inputPatternType) << std::endl;
-      openMVG::calibration::Pattern patternType = getPatternType(inputPatternType);
-      std::cout << "patternType openMVG: " << int(patternType) << std::endl;
-      std::vector<cv::Point2f> checkerPoints;
-      found = openMVG::calibration::findPattern(patternType, cvInputGrayImage, boardSize, checkerPoints);
-      if(found)
-        checkerPerFrame[args.time] = checkerPoints;
+        return findPatternCoarseToFine(jobPtr->grayImage, settings, jobPtr->checkerPoints, jobPtr->stats);
+      });
+      jobs.push_back(std::move(job));
     }
-    OFX::Image *outputPtr = _dstClip->fetchImage(args.time);
-    if(outputPtr == NULL)
+
+    while(jobs.size() >= maxJobsInFlight || (i + 1 == nbFrames && !jobs.empty()))
     {
-      std::cout << "Output image is NULL" << std::endl;
-      return;
+      commitOldestJob();
     }
-    Common::Image<float> outputImage(outputPtr, Common::eOrientationTopDown);
-    outputImage.copyFrom(inputImageOFX);
 
-    if(found)
-      std::cout << "Checker found at time " << args.time << "." << std::endl;
-    else
-      std::cout << "Checker NOT found at time " << args.time << "." << std::endl;
+    if(!progressUpdate(double(nbFramesDone) / double(nbFrames)))
+    {
+      canceled = true;
+    }
+  }
 
-    std::cout << "checkerPerFrame.size(): " << checkerPerFrame.size() << std::endl;
-    std::cout << "checkerPerFrame.at(time).size(): " << checkerPerFrame.at(args.time).size() << std::endl;
-    // TODO: export number of images for calibration to a user parameter
+  //Wait for the jobs in flight after a cancel
+  while(!jobs.empty())
+  {
+    commitOldestJob();
   }
+
+  progressEnd();
+
+  std::lock_guard<std::mutex> guard(_checkerMutex);
+  std::cout << "detectAll : [done] checker found on " << checkerPerFrame.size() << " frames" << (canceled ? " (canceled)" : "") << std::endl;
+}
+
+void LensCalibrationPlugin::clearDetections()
+{
+  std::unique_lock<std::mutex> lock(_checkerMutex);
+  _checkerCondition.wait(lock, [&]() { return _detectingFrames.empty(); });
+  checkerPerFrame.clear();
+  _checkerNotFoundFrames.clear();
+  _detectionStats = DetectionStats();
+  _debugDetectionStats->setValue(detectionStatsToString(_detectionStats));
+  _isDetectionsLoaded = false;
+}
+
+CalibrationSettings LensCalibrationPlugin::getCalibrationSettings()
+{
+  CalibrationSettings settings;
+  const OfxPointI imageSizeValue(_inputImageSize->getValue());
+  settings.pattern = getPatternSettings();
+  settings.imageSize = cv::Size(imageSizeValue.x, imageSizeValue.y);
+  settings.squareSize = _inputSquareSize->getValue();
+  settings.lensModel = EParamLensModel(_inputLensModel->getValue());
+  settings.nbRadialCoef = _inputNbRadialCoef->getValue();
+  settings.maxCalibFrames = _inputMaxCalibFrames->getValue();
+  settings.calibGridSize = _inputCalibGridSize->getValue();
+  settings.minInputFrames = _inputMinInputFrames->getValue();
+  settings.maxTotalAvgErr = _inputMaxTotalAvgErr->getValue();
+  return settings;
 }
 
 void LensCalibrationPlugin::calibrateLens()
 {
-  if(checkerPerFrame.empty())
-    throw std::logic_error("No checkerboard detected.");
-  
-  OfxPointI p(_inputPatternSize->getValue());
-  cv::Size boardSize(p.x, p.y);
-  EParamPatternType inputPatternType = EParamPatternType(_inputPatternType->getValue());
-  openMVG::calibration::Pattern patternType = getPatternType(inputPatternType);
-  
-  std::vector<std::size_t> remainingImagesIndexes(checkerPerFrame.size());
-  std::vector<float> calibImageScore;
-  std::vector<std::size_t> calibInputFrames;
+  ensureDetectionsLoaded();
+
+  const CalibrationSettings settings = getCalibrationSettings();
+
+  // Only the corners of the selected frames are copied, renders can add detections meanwhile
   std::vector<std::vector<cv::Point2f> > calibImagePoints;
-  std::vector<long unsigned int> validFrames;
-  std::vector<std::vector<cv::Point2f> > imagePoints;
-  
-  OfxPointI imageSizeValue(_inputImageSize->getValue());
-  cv::Size imageSize(imageSizeValue.x, imageSizeValue.y);
+  {
+    std::lock_guard<std::mutex> guard(_checkerMutex);
+    if(checkerPerFrame.empty())
+      throw std::logic_error("No checkerboard detected.");
+
+    std::vector<OfxTime> calibInputFrames;
+    std::vector<float> calibImageScore;
+    selectCalibrationFrames(checkerPerFrame, settings.imageSize, settings.maxCalibFrames, settings.calibGridSize, calibInputFrames, calibImageScore);
+
+    calibImagePoints.reserve(calibInputFrames.size());
+    for(OfxTime time : calibInputFrames)
+      calibImagePoints.push_back(checkerPerFrame.at(time));
+  }
 
-  for (std::map<OfxTime, std::vector<cv::Point2f> >::iterator it = checkerPerFrame.begin(); it != checkerPerFrame.end(); ++it)
+  // Shared with the worker
+  std::mutex progressMutex;
+  CalibrationProgress progress;
+  std::atomic<bool> canceled(false);
+  CalibrationResult result;
+
+  //Host calls stay on this thread, the worker only solves
+  std::future<bool> solved = std::async(std::launch::async, [&]()
+  {
+    return solveCalibration(std::move(calibImagePoints), settings, [&](const CalibrationProgress &current)
+    {
+      std::lock_guard<std::mutex> guard(progressMutex);
+      progress = current;
+      return !canceled;
+    }, result);
+  });
+
+  progressStart("Lens calibration");
+  std::size_t displayedIteration = 0;
+  while(solved.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
   {
-    validFrames.push_back(it->first);
-    imagePoints.push_back(it->second);
+    CalibrationProgress current;
+    {
+      std::lock_guard<std::mutex> guard(progressMutex);
+      current = progress;
+    }
+    if(current.iteration != displayedIteration)
+    {
+      std::cout << "calibrateLens : [info] " << calibrationProgressToString(current) << std::endl;
+      _outputCalibrationStatus->setValue(calibrationProgressToString(current));
+      displayedIteration = current.iteration;
+    }
+
+    // The rejection loop stops at Min Input Frames at the latest
+    const std::size_t nbRejectable = current.nbInputFrames - std::min(current.nbInputFrames, settings.minInputFrames);
+    const double fraction = (nbRejectable == 0) ? 0.0 : std::min(0.99, double(current.nbRejectedFrames) / double(nbRejectable));
+    if(!canceled && !progressUpdate(fraction))
+      canceled = true;
   }
-  
-  openMVG::calibration::selectBestImages(imagePoints, imageSize, remainingImagesIndexes, _inputMaxCalibFrames->getValue(),
-                                        validFrames, calibImageScore, calibInputFrames, calibImagePoints, _inputCalibGridSize->getValue());
-  
-  std::vector<std::vector<cv::Point3f> > calibObjectPoints;
-  openMVG::calibration::computeObjectPoints(boardSize, patternType, _inputSquareSize->getValue(), calibImagePoints, calibObjectPoints);
-
-  int cvCalibFlags = 0;
-  double totalAvgErr = 0;
-  std::vector<cv::Mat> rvecs;
-  float aspectRatio = 1.f;
-  std::vector<cv::Mat> tvecs;
-  std::vector<float> reprojErrs;
-  std::vector<std::size_t> rejectInputFrames;
-  
-  cvCalibFlags |= CV_CALIB_ZERO_TANGENT_DIST;
-  const std::array<int, 6> fixDistortionCoefs = {CV_CALIB_FIX_K1, CV_CALIB_FIX_K2, CV_CALIB_FIX_K3, CV_CALIB_FIX_K4, CV_CALIB_FIX_K5, CV_CALIB_FIX_K6};
-  for (int i = _inputNbRadialCoef->getValue(); i < 6; ++i)
-      cvCalibFlags |= fixDistortionCoefs[i];
-  
-  cv::Mat distCoeffs;
-  cv::Mat cameraMatrix;
-  bool isCalibrated = openMVG::calibration::calibrationIterativeOptimization(calibImagePoints,
-                                                                             calibObjectPoints,
-                                                                             imageSize,
-                                                                             aspectRatio,
-                                                                             cvCalibFlags,
-                                                                             cameraMatrix,
-                                                                             distCoeffs,
-                                                                             rvecs,
-                                                                             tvecs,
-                                                                             reprojErrs,
-                                                                             totalAvgErr, 
-                                                                             _inputMaxTotalAvgErr->getValue(),
-                                                                             _inputMinInputFrames->getValue(),
-                                                                             calibInputFrames,
-                                                                             calibImageScore,
-                                                                             rejectInputFrames);
-  
-  setOutputParams(_outputCameraFocalLenght,
-                  _outputCameraPrincipalPointOffset,
-                  _outputLensDistortionRadialCoef1,
-                  _outputLensDistortionRadialCoef2,
-                  _outputLensDistortionRadialCoef3,
-                  _outputLensDistortionTangentialCoef1,
-                  _outputLensDistortionTangentialCoef2,
-                  cameraMatrix, distCoeffs);
-  
-  _outputIsCalibrated->setValue(isCalibrated);
+  progressEnd();
+
+  bool isSolved = false;
+  try
+  {
+    isSolved = solved.get();
+  }
+  catch(std::exception &e)
+  {
+    _outputCalibrationStatus->setValue(std::string("failed : ") + e.what());
+    sendMessage(OFX::Message::eMessageError, "lenscalibration.calibrate", std::string("Calibration failed : ") + e.what());
+    return;
+  }
+
+  if(!isSolved)
+  {
+    _outputCalibrationStatus->setValue("canceled at " + calibrationProgressToString(progress));
+    std::cout << "calibrateLens : [canceled]" << std::endl;
+    return;
+  }
+  _outputCalibrationStatus->setValue(calibrationProgressToString(progress));
+
+  // All the outputs are set together, undone as one edit
+  beginEditBlock("Lens calibration");
+  setCalibratedCamera(result.camera);
+  _outputAvgReprojErr->setValue(result.totalAvgErr);
+  _outputIsCalibrated->setValue(result.isCalibrated);
+  endEditBlock();
 }
 
 
@@ -249,7 +656,13 @@ bool LensCalibrationPlugin::isIdentity(const OFX::IsIdentityArguments &args, OFX
 
 void LensCalibrationPlugin::changedClip(const OFX::InstanceChangedArgs &args, const std::string &clipName)
 {
-  
+  // Another input, the detections files of the previous one can't be used
+  if(clipName == kOfxImageEffectSimpleSourceClipName && args.reason == OFX::InstanceChangeReason::eChangeUserEdit)
+  {
+    releaseDetectionPrefix(_detectionCacheFile->getValue());
+    createDetectionCacheFile();
+    clearDetections();
+  }
 }
 
 void LensCalibrationPlugin::changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName)
@@ -266,6 +679,21 @@ void LensCalibrationPlugin::changedParam(const OFX::InstanceChangedArgs &args, c
     return;
   }
   
+  //Detect All
+  if(paramName == kParamDetectAll)
+  {
+    detectAll();
+    return;
+  }
+
+  //Detections are only valid for one pattern
+  if(paramName == kParamPatternType || paramName == kParamPatternSize || paramName == kParamInputImageIsGray ||
+     paramName == kParamDetectionMaxSize)
+  {
+    clearDetections();
+    return;
+  }
+
   //Clear All
   if(paramName == kParamOutputClear)
   {
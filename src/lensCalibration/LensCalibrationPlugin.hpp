@@ -2,11 +2,18 @@
 #include "ofxsImageEffect.h"
 #include "LensCalibrationPluginFactory.hpp"
 #include "LensCalibrationPluginDefinition.hpp"
+#include "LensCalibration.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+
 namespace openMVG_ofx {
 namespace LensCalibration {
 
@@ -27,24 +34,34 @@ private:
   OFX::BooleanParam *_inputImageIsGray = fetchBooleanParam(kParamInputImageIsGray);
   OFX::ChoiceParam *_inputPatternType = fetchChoiceParam(kParamPatternType);
   OFX::Int2DParam *_inputPatternSize = fetchInt2DParam(kParamPatternSize);
+  OFX::IntParam *_inputDetectionMaxSize = fetchIntParam(kParamDetectionMaxSize);
   OFX::DoubleParam *_inputSquareSize = fetchDoubleParam(kParamSquareSize);
+  OFX::ChoiceParam *_inputLensModel = fetchChoiceParam(kParamLensModel);
   OFX::IntParam *_inputNbRadialCoef = fetchIntParam(kParamNbRadialCoef);
   OFX::IntParam *_inputMaxFrames = fetchIntParam(kParamMaxFrames);
   OFX::IntParam *_inputMaxCalibFrames = fetchIntParam(kParamMaxCalibFrames);
   OFX::IntParam *_inputCalibGridSize = fetchIntParam(kParamCalibGridSize);
   OFX::IntParam *_inputMinInputFrames = fetchIntParam(kParamMinInputFrames);
   OFX::DoubleParam *_inputMaxTotalAvgErr = fetchDoubleParam(kParamMaxTotalAvgErr);
+  OFX::PushButtonParam *_inputDetectAll = fetchPushButtonParam(kParamDetectAll);
   OFX::PushButtonParam *_outputCalibrate = fetchPushButtonParam(kParamCalibrate);
+  OFX::StringParam *_detectionCacheFile = fetchStringParam(kParamDetectionCacheFile);
 
   //Output parameters
   OFX::BooleanParam *_outputIsCalibrated = fetchBooleanParam(kParamOutputIsCalibrated);
   OFX::DoubleParam *_outputAvgReprojErr = fetchDoubleParam(kParamOutputAvgReprojErr);
+  OFX::StringParam *_outputCalibrationStatus = fetchStringParam(kParamOutputCalibrationStatus);
   OFX::DoubleParam *_outputCameraFocalLenght = fetchDoubleParam(kParamOutputFocalLenght);
+  OFX::DoubleParam *_outputCameraFocalRatio = fetchDoubleParam(kParamOutputFocalRatio);
   OFX::Double2DParam *_outputCameraPrincipalPointOffset = fetchDouble2DParam(kParamOutputPrincipalPointOffset);
 
+  OFX::ChoiceParam *_outputLensModel = fetchChoiceParam(kParamOutputLensModel);
   OFX::DoubleParam *_outputLensDistortionRadialCoef1 = fetchDoubleParam(kParamOutputRadialCoef1);
   OFX::DoubleParam *_outputLensDistortionRadialCoef2 = fetchDoubleParam(kParamOutputRadialCoef2);
   OFX::DoubleParam *_outputLensDistortionRadialCoef3 = fetchDoubleParam(kParamOutputRadialCoef3);
+  OFX::DoubleParam *_outputLensDistortionRadialCoef4 = fetchDoubleParam(kParamOutputRadialCoef4);
+  OFX::DoubleParam *_outputLensDistortionRadialCoef5 = fetchDoubleParam(kParamOutputRadialCoef5);
+  OFX::DoubleParam *_outputLensDistortionRadialCoef6 = fetchDoubleParam(kParamOutputRadialCoef6);
   OFX::DoubleParam *_outputLensDistortionTangentialCoef1 = fetchDoubleParam(kParamOutputTangentialCoef1);
   OFX::DoubleParam *_outputLensDistortionTangentialCoef2 = fetchDoubleParam(kParamOutputTangentialCoef2);
   OFX::PushButtonParam *_outputClear = fetchPushButtonParam(kParamOutputClear);
@@ -53,12 +70,20 @@ private:
   OFX::BooleanParam *_debugEnable = fetchBooleanParam(kParamDebugEnable);
   OFX::StringParam *_debugRejectedImgFolder = fetchStringParam(kParamDebugRejectedImgFolder);
   OFX::StringParam *_debugSelectedImgFolder = fetchStringParam(kParamDebugSelectedImgFolder);
+  OFX::StringParam *_debugDetectionStats = fetchStringParam(kParamDebugDetectionStats);
 
   //Output Parameters List
   std::vector<OFX::ValueParam*> _outputParams;
   
-  // Cache
+  // Cache, renders of several frames and tiles run in parallel
+  std::mutex _checkerMutex;
+  std::condition_variable _checkerCondition;
   std::map<OfxTime, std::vector<cv::Point2f> > checkerPerFrame;
+  std::set<OfxTime> _checkerNotFoundFrames;
+  std::set<OfxTime> _detectingFrames;
+  DetectionStats _detectionStats;
+  std::uint64_t _loadedDetectionsKey = 0; //detections file loaded in the maps
+  bool _isDetectionsLoaded = false;
 
 public:
   
@@ -68,6 +93,12 @@ public:
    */
   LensCalibrationPlugin(OfxImageEffectHandle handle);
 
+  /**
+   * @brief Plugin Destructor
+   * Release the detections file prefix, see createDetectionCacheFile
+   */
+  ~LensCalibrationPlugin();
+
   /** @brief The sync private data action, called when the effect needs to sync any private data to persistant parameters */
   void syncPrivateData();
 
@@ -89,6 +120,15 @@ public:
    */
   virtual void render(const OFX::RenderArguments &args);
 
+  /**
+   * @brief Override getRegionsOfInterest method
+   * The pattern detection needs the whole input frame, the undistortion only
+   * needs the distorted region of the render window.
+   * @param[in] args
+   * @param[out] rois
+   */
+  virtual void getRegionsOfInterest(const OFX::RegionsOfInterestArguments &args, OFX::RegionOfInterestSetter &rois);
+
   /**
    * @brief Override isIdentity method
    * @param[in] args
@@ -113,7 +153,107 @@ public:
   virtual void changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName);
   
 private:
+  /**
+   * @brief Calibrate the lens from the pattern detections
+   * The solve runs on a worker thread, the host progress is updated meanwhile
+   * and can cancel it. The output parameters are only set when it succeeds.
+   */
   void calibrateLens();
+
+  /**
+   * @brief Get the calibration settings from the parameters
+   */
+  CalibrationSettings getCalibrationSettings();
+
+  /**
+   * @brief Get the calibrated camera from the output parameters
+   * Only the coefficients of the output lens model are used.
+   * @param[in] width
+   * @param[in] height
+   */
+  LensCamera getCalibratedCamera(std::size_t width, std::size_t height);
+
+  /**
+   * @brief Set the calibrated camera into the output parameters
+   * @param[in] camera
+   */
+  void setCalibratedCamera(const LensCamera &camera);
+
+  /**
+   * @brief Get the pattern detection settings from the parameters
+   */
+  PatternSettings getPatternSettings();
+
+  /**
+   * @brief Create a new detections file prefix, owned by this instance
+   * A prefix is only used by one living instance: a copied node gets its own.
+   */
+  void createDetectionCacheFile();
+
+  /**
+   * @brief Get the detections file path for a detection key
+   * The file path prefix is created once per plugin instance and saved in the project.
+   * @param[in] key
+   */
+  std::string getDetectionsFilePath(std::uint64_t key);
+
+  /**
+   * @brief Get the key of the current detections
+   * Hash of the pattern settings and of the input clip frame range and size.
+   */
+  std::uint64_t getDetectionsKey();
+
+  /**
+   * @brief Load the detections file of the current key, if not already loaded
+   * Thread safe, the in-memory detections of another key are forgotten.
+   */
+  void ensureDetectionsLoaded();
+
+  /**
+   * @brief Reserve the detection of a frame
+   * Thread safe, waits if the frame is being detected.
+   * @param[in] time
+   * @param[in] frame - input frame, in pixels
+   * @return false if the frame is already detected or hasn't the calibration image size
+   */
+  bool beginDetection(OfxTime time, const OfxRectI &frame);
+
+  /**
+   * @brief Store the detection of a frame reserved with beginDetection
+   * @param[in] time
+   * @param[in] found
+   * @param[in] checkerPoints
+   * @param[in] stats - counters of the frame detection
+   */
+  void endDetection(OfxTime time, bool found, const std::vector<cv::Point2f> &checkerPoints, const DetectionStats &stats);
+
+  /**
+   * @brief Release a frame reserved with beginDetection without storing anything
+   * A failed detection is not a "not found" frame, it is detected again later.
+   * @param[in] time
+   */
+  void cancelDetection(OfxTime time);
+
+  /**
+   * @brief Detect the calibration pattern of a frame, if not already done
+   * Thread safe, concurrent calls for the same frame wait for the first one.
+   * @param[in] time
+   * @param[in] inputPtr - the whole input frame
+   */
+  void detectPattern(OfxTime time, OFX::Image *inputPtr);
+
+  /**
+   * @brief Detect the calibration pattern on the input clip frames
+   * At most Max Frames frames evenly spaced are detected on a thread pool.
+   * Can be canceled from the host progress.
+   */
+  void detectAll();
+
+  /**
+   * @brief Forget the in-memory pattern detections of all the frames
+   * The detections files are kept, they are reloaded if the settings are restored.
+   */
+  void clearDetections();
   
   void clearOutputParamValues()
   {
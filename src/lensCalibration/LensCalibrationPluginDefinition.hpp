@@ -14,14 +14,18 @@
 #define kParamImageSize "imageSize"
 #define kParamPatternType "patternType"
 #define kParamPatternSize "patternSize"
+#define kParamDetectionMaxSize "detectionMaxSize"
 #define kParamSquareSize "SquareSize"
+#define kParamLensModel "lensModel"
 #define kParamNbRadialCoef "nbRadialCoef"
 #define kParamMaxFrames "maxFrames"
 #define kParamMaxCalibFrames "maxCalibFrames"
 #define kParamCalibGridSize "calibGridSize"
 #define kParamMinInputFrames "minInputFrames"
 #define kParamMaxTotalAvgErr "maxTotalAvgErr"
+#define kParamDetectAll "detectAll"
 #define kParamCalibrate "outputCalibrate"
+#define kParamDetectionCacheFile "detectionCacheFile"
 
 //Debug parameters
 #define kParamGroupDebug "groupDebug"
@@ -29,24 +33,32 @@
 #define kParamDebugEnable "debugEnable"
 #define kParamDebugRejectedImgFolder "debugRejectedImgFolder"
 #define kParamDebugSelectedImgFolder "debugSelectedImgFolder"
+#define kParamDebugDetectionStats "debugDetectionStats"
 
 //Output parameters
 #define kParamGroupOutput "groupOutput"
 
 #define kParamOutputAvgReprojErr "outputAvgReprojErr"
 #define kParamOutputIsCalibrated "outputIsCalibrated"
+#define kParamOutputCalibrationStatus "outputCalibrationStatus"
 #define kParamOutputClear "outputClear"
 
 #define kParamOutputCameraGroup "groupCamera"
 
 #define kParamOutputFocalLenght "outputFocalLenght"
+#define kParamOutputFocalRatio "outputFocalRatio"
 #define kParamOutputPrincipalPointOffset "outputPrincipalPointOffset"
 
 #define kParamOutputLensDistortionGroup "groupLensDistortion"
 
+#define kParamOutputLensModel "outputLensModel"
+
 #define kParamOutputRadialCoef1 "outputRadialCoef1"
 #define kParamOutputRadialCoef2 "outputRadialCoef2"
 #define kParamOutputRadialCoef3 "outputRadialCoef3"
+#define kParamOutputRadialCoef4 "outputRadialCoef4"
+#define kParamOutputRadialCoef5 "outputRadialCoef5"
+#define kParamOutputRadialCoef6 "outputRadialCoef6"
 #define kParamOutputTangentialCoef1 "outputTangentialCoef1"
 #define kParamOutputTangentialCoef2 "outputTangentialCoef2"
 
@@ -75,5 +87,21 @@ static const std::vector< std::pair<std::string, std::string> > kStringParamPatt
   {"CCTag", ""}
 };
 
+//kParamLensModel options
+enum EParamLensModel
+{
+  eParamLensModelRadialK3 = 0,
+  eParamLensModelBrown,
+  eParamLensModelRational,
+  eParamLensModelFisheye
+};
+
+static const std::vector< std::pair<std::string, std::string> > kStringParamLensModel = {
+  {"Radial K3", "Radial coefficients K1 to K3"},
+  {"Brown", "Radial coefficients K1 to K3 and tangential coefficients P1 P2"},
+  {"Rational", "Rational radial coefficients K1 to K6 and tangential coefficients P1 P2"},
+  {"Fisheye", "Equidistant fisheye with coefficients K1 to K4"}
+};
+
 } //namespace LensCalibration
 } //namespace openMVG_ofx
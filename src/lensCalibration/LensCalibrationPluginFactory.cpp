@@ -37,9 +37,10 @@ void LensCalibrationPluginFactory::describe(OFX::ImageEffectDescriptor& desc)
 
   //Flags
   desc.setSingleInstance(false);
-  desc.setHostFrameThreading(false);
+  desc.setHostFrameThreading(true);
   desc.setSupportsMultiResolution(false);
-  desc.setSupportsTiles(false);
+  desc.setSupportsTiles(true);
+  desc.setRenderThreadSafety(OFX::eRenderFullySafe);
   desc.setTemporalClipAccess(false);
   desc.setRenderTwiceAlways(false);
   desc.setSupportsMultipleClipPARs(false);
@@ -53,14 +54,14 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
   OFX::ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
   srcClip->addSupportedComponent(OFX::ePixelComponentRGBA);
   srcClip->setTemporalClipAccess(false);
-  srcClip->setSupportsTiles(false);
+  srcClip->setSupportsTiles(true);
   srcClip->setIsMask(false);
   srcClip->setOptional(false);
   
   //Output clip
   OFX::ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
   dstClip->addSupportedComponent(OFX::ePixelComponentRGBA);
-  dstClip->setSupportsTiles(false);
+  dstClip->setSupportsTiles(true);
   
   //Calibration Group
   {
@@ -106,6 +107,18 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
       param->setAnimates(false);
       param->setParent(*groupCalibration);
     }
+
+    {
+      OFX::IntParamDescriptor *param = desc.defineIntParam(kParamDetectionMaxSize);
+      param->setLabel("Detection Max Size");
+      param->setHint("Chessboards are first searched on an image downscaled to this size, frames without board are rejected there. "
+                     "Corners are then refined at full resolution. 0 to search at full resolution.");
+      param->setRange(0, kOfxFlagInfiniteMax);
+      param->setDisplayRange(0, 4096);
+      param->setDefault(1024);
+      param->setAnimates(false);
+      param->setParent(*groupCalibration);
+    }
     
     {
       OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamSquareSize);
@@ -118,10 +131,20 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
       param->setLayoutHint(OFX::eLayoutHintDivider);
     }
 
+    {
+      OFX::ChoiceParamDescriptor *param = desc.defineChoiceParam(kParamLensModel);
+      param->setLabel("Lens Model");
+      param->setHint("Distortion model of the lens to calibrate");
+      param->appendOptions(kStringParamLensModel);
+      param->setDefault(eParamLensModelRadialK3);
+      param->setAnimates(false);
+      param->setParent(*groupCalibration);
+    }
+
     {
       OFX::IntParamDescriptor *param = desc.defineIntParam(kParamNbRadialCoef);
       param->setLabel("Nb Radial Coef");
-      param->setHint("Number of radial coefficient.");
+      param->setHint("Number of radial coefficient. Up to 3 for Radial K3 and Brown, 6 for Rational and 4 for Fisheye.");
       param->setRange(0, 6);
       param->setDisplayRange(0, 6);
       param->setDefault(3);
@@ -184,6 +207,13 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
       param->setParent(*groupCalibration);
     }
     
+    {
+      OFX::PushButtonParamDescriptor *param = desc.definePushButtonParam(kParamDetectAll);
+      param->setLabel("Detect All");
+      param->setHint("Detect the pattern on the frames of the input clip, on Max Frames frames evenly spaced if set.");
+      param->setParent(*groupCalibration);
+    }
+
     {
       OFX::PushButtonParamDescriptor *param = desc.definePushButtonParam(kParamCalibrate);
       param->setLabel("Calibrate");
@@ -214,6 +244,16 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
       param->setEnabled(false);
       param->setAnimates(true);
       param->setParent(*groupOutput);
+    }
+
+    {
+      OFX::StringParamDescriptor *param = desc.defineStringParam(kParamOutputCalibrationStatus);
+      param->setLabel("Calibration Status");
+      param->setHint("Last calibration iteration, frames used and rejected, and average reprojection error.");
+      param->setStringType(OFX::eStringTypeSingleLine);
+      param->setEvaluateOnChange(false);
+      param->setEnabled(false);
+      param->setParent(*groupOutput);
       param->setLayoutHint(OFX::eLayoutHintDivider);
     }
     
@@ -234,6 +274,18 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
         param->setParent(*groupCamera);
       }
 
+      {
+        OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamOutputFocalRatio);
+        param->setLabel("Focal Ratio");
+        param->setHint("Vertical focal length divided by the horizontal one");
+        param->setDisplayRange(0, 2);
+        param->setDefault(1);
+        param->setEvaluateOnChange(false);
+        param->setEnabled(false);
+        param->setAnimates(false);
+        param->setParent(*groupCamera);
+      }
+
       {
         OFX::Double2DParamDescriptor *param = desc.defineDouble2DParam(kParamOutputPrincipalPointOffset);
         param->setLabel("Principal Point");
@@ -250,6 +302,18 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
       groupLensDistortion->setLabel("Lens Distortion Coefficients");
       groupLensDistortion->setParent(*groupOutput);
       groupLensDistortion->setOpen(true);
+
+      {
+        OFX::ChoiceParamDescriptor *param = desc.defineChoiceParam(kParamOutputLensModel);
+        param->setLabel("Lens Model");
+        param->setHint("Distortion model of the calibrated coefficients. Fisheye uses Radial Coef1 to Coef4.");
+        param->appendOptions(kStringParamLensModel);
+        param->setDefault(eParamLensModelRadialK3);
+        param->setEvaluateOnChange(false);
+        param->setEnabled(false);
+        param->setAnimates(false);
+        param->setParent(*groupLensDistortion);
+      }
         
       {
         OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamOutputRadialCoef1);
@@ -284,6 +348,39 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
         param->setParent(*groupLensDistortion);
       }
 
+      {
+        OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamOutputRadialCoef4);
+        param->setLabel("Radial Coef4");
+        param->setDisplayRange(0, 10);
+        param->setAnimates(true);
+        param->setEvaluateOnChange(false);
+        param->setEnabled(false);
+        param->setAnimates(false);
+        param->setParent(*groupLensDistortion);
+      }
+
+      {
+        OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamOutputRadialCoef5);
+        param->setLabel("Radial Coef5");
+        param->setDisplayRange(0, 10);
+        param->setAnimates(true);
+        param->setEvaluateOnChange(false);
+        param->setEnabled(false);
+        param->setAnimates(false);
+        param->setParent(*groupLensDistortion);
+      }
+
+      {
+        OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamOutputRadialCoef6);
+        param->setLabel("Radial Coef6");
+        param->setDisplayRange(0, 10);
+        param->setAnimates(true);
+        param->setEvaluateOnChange(false);
+        param->setEnabled(false);
+        param->setAnimates(false);
+        param->setParent(*groupLensDistortion);
+      }
+
       {
         OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamOutputTangentialCoef1);
         param->setLabel("Tangential Coef1");
@@ -347,6 +444,27 @@ void LensCalibrationPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
       param->setFilePathExists(true);
       param->setParent(*groupDebug);
     }
+
+    {
+      OFX::StringParamDescriptor *param = desc.defineStringParam(kParamDebugDetectionStats);
+      param->setLabel("Detection Stats");
+      param->setHint("Frames rejected on the downscaled image, refined at full resolution, and detected at full resolution.");
+      param->setStringType(OFX::eStringTypeMultiLine);
+      param->setEvaluateOnChange(false);
+      param->setEnabled(false);
+      param->setParent(*groupDebug);
+    }
+  }
+
+  {
+    OFX::StringParamDescriptor *param = desc.defineStringParam(kParamDetectionCacheFile);
+    param->setLabel("Detection Cache");
+    param->setHint("Allow the plugin to find its pattern detection cache files");
+    param->setIsSecret(true);
+    param->setEnabled(false);
+    param->setStringType(OFX::eStringTypeSingleLine);
+    param->setEvaluateOnChange(false);
+    param->setCanUndo(false);
   }
 }
 
@@ -0,0 +1,159 @@
+#include "LensCalibrationSelection.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <utility>
+
+namespace openMVG_ofx {
+namespace LensCalibration {
+
+namespace {
+
+//FrameCoverage structure for the grid cells covered by the corners of a frame
+struct FrameCoverage
+{
+  OfxTime time;
+  std::size_t nbPoints;
+  std::vector< std::pair<std::size_t, std::size_t> > cells; //cell index and number of corners, by cell index
+};
+
+//ScoredFrame structure for a frame score computed with the weights of a selection step
+struct ScoredFrame
+{
+  float score;
+  std::size_t index;
+  std::size_t step;
+
+  bool operator>(const ScoredFrame &other) const
+  {
+    return std::tie(score, index) > std::tie(other.score, other.index);
+  }
+};
+
+inline std::size_t getCellCoordinate(float position, float cellSize, std::size_t gridSize)
+{
+  const float cell = std::floor(position / cellSize);
+  if(!(cell > 0.f))
+    return 0;
+  return std::min(static_cast<std::size_t>(cell), gridSize - 1);
+}
+
+//Integer sum, the float result is the same as the accumulation in openMVG
+inline float computeScore(const FrameCoverage &frame, const std::vector<std::size_t> &cellsWeight)
+{
+  std::size_t sum = 0;
+  for(const auto &cell : frame.cells)
+    sum += cell.second * cellsWeight[cell.first];
+  return static_cast<float>(sum) / static_cast<float>(frame.nbPoints);
+}
+
+} //namespace
+
+void selectCalibrationFrames(const std::map<OfxTime, std::vector<cv::Point2f> > &checkerPerFrame,
+                             const cv::Size &imageSize,
+                             std::size_t maxCalibFrames,
+                             std::size_t calibGridSize,
+                             std::vector<OfxTime> &calibInputFrames,
+                             std::vector<float> &calibImageScore)
+{
+  calibInputFrames.clear();
+  calibImageScore.clear();
+
+  const std::size_t gridSize = std::max<std::size_t>(calibGridSize, 1);
+  const float cellWidth = static_cast<float>(imageSize.width) / static_cast<float>(gridSize);
+  const float cellHeight = static_cast<float>(imageSize.height) / static_cast<float>(gridSize);
+
+  std::vector<FrameCoverage> frames;
+  frames.reserve(checkerPerFrame.size());
+  std::vector<std::size_t> pointCells;
+  for(const auto &frameCheckerPoints : checkerPerFrame)
+  {
+    if(frameCheckerPoints.second.empty())
+      continue;
+
+    pointCells.clear();
+    for(const cv::Point2f &point : frameCheckerPoints.second)
+    {
+      pointCells.push_back(getCellCoordinate(point.y, cellHeight, gridSize) * gridSize
+                           + getCellCoordinate(point.x, cellWidth, gridSize));
+    }
+    std::sort(pointCells.begin(), pointCells.end());
+
+    FrameCoverage frame;
+    frame.time = frameCheckerPoints.first;
+    frame.nbPoints = pointCells.size();
+    for(std::size_t cell : pointCells)
+    {
+      if(frame.cells.empty() || frame.cells.back().first != cell)
+        frame.cells.emplace_back(cell, 0);
+      ++frame.cells.back().second;
+    }
+    frames.push_back(std::move(frame));
+  }
+
+  if(frames.empty() || maxCalibFrames == 0)
+    return;
+
+  // The first frame is the one on the cells least covered by all the frames
+  std::vector<std::size_t> cellsWeight(gridSize * gridSize, 0);
+  for(const FrameCoverage &frame : frames)
+  {
+    for(const auto &cell : frame.cells)
+      ++cellsWeight[cell.first];
+  }
+
+  std::size_t bestIndex = 0;
+  float bestScore = std::numeric_limits<float>::max();
+  for(std::size_t i = 0; i < frames.size(); ++i)
+  {
+    const float score = computeScore(frames[i], cellsWeight);
+    if(score < bestScore)
+    {
+      bestScore = score;
+      bestIndex = i;
+    }
+  }
+  calibInputFrames.push_back(frames[bestIndex].time);
+  calibImageScore.push_back(bestScore);
+
+  // Then the cells least covered by the selected frames
+  std::fill(cellsWeight.begin(), cellsWeight.end(), 0);
+  for(const auto &cell : frames[bestIndex].cells)
+    ++cellsWeight[cell.first];
+
+  std::size_t step = 1;
+  std::priority_queue<ScoredFrame, std::vector<ScoredFrame>, std::greater<ScoredFrame> > queue;
+  for(std::size_t i = 0; i < frames.size(); ++i)
+  {
+    if(i != bestIndex)
+      queue.push(ScoredFrame{computeScore(frames[i], cellsWeight), i, step});
+  }
+
+  while(calibInputFrames.size() < maxCalibFrames && !queue.empty())
+  {
+    ScoredFrame best = queue.top();
+    queue.pop();
+
+    if(best.step != step)
+    {
+      // The outdated score is a lower bound, the frame is put back with its current score
+      best.score = computeScore(frames[best.index], cellsWeight);
+      best.step = step;
+      queue.push(best);
+      continue;
+    }
+
+    calibInputFrames.push_back(frames[best.index].time);
+    calibImageScore.push_back(best.score);
+    for(const auto &cell : frames[best.index].cells)
+      ++cellsWeight[cell.first];
+    ++step;
+  }
+}
+
+} //namespace LensCalibration
+} //namespace openMVG_ofx
@@ -0,0 +1,37 @@
+#pragma once
+#include "ofxsImageEffect.h"
+
+#include <opencv2/core/core.hpp>
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace openMVG_ofx {
+namespace LensCalibration {
+
+/**
+ * @brief Select the frames covering the image best for the calibration
+ * Same selection as openMVG selectBestImages: the image is split in a grid, a
+ * frame score is the average over its corners of the number of selected frames
+ * covering the corner cell, and the frame with the lowest score is selected
+ * until maxCalibFrames frames are selected. The first frame is scored with the
+ * coverage of all the frames.
+ * Scores only increase as frames are selected, so outdated scores are kept in
+ * a priority queue and only recomputed when they reach the top.
+ * @param[in] checkerPerFrame - read in place, the corners aren't copied
+ * @param[in] imageSize
+ * @param[in] maxCalibFrames
+ * @param[in] calibGridSize - number of cells per edge
+ * @param[out] calibInputFrames - selected frames, in selection order
+ * @param[out] calibImageScore - score of the selected frames
+ */
+void selectCalibrationFrames(const std::map<OfxTime, std::vector<cv::Point2f> > &checkerPerFrame,
+                             const cv::Size &imageSize,
+                             std::size_t maxCalibFrames,
+                             std::size_t calibGridSize,
+                             std::vector<OfxTime> &calibInputFrames,
+                             std::vector<float> &calibImageScore);
+
+} //namespace LensCalibration
+} //namespace openMVG_ofx
@@ -0,0 +1,263 @@
+#include "LensCalibrationSolver.hpp"
+#include "../common/ThreadPool.hpp"
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace openMVG_ofx {
+namespace LensCalibration {
+
+namespace {
+
+typedef Eigen::Matrix<double, kNbCameraParams, kNbCameraParams> CameraMatrix;
+typedef Eigen::Matrix<double, kNbCameraParams, 1> CameraVector;
+typedef Eigen::Matrix<double, kNbCameraParams, 6> CameraPoseMatrix;
+typedef Eigen::Matrix<double, 6, 6> PoseMatrix;
+typedef Eigen::Matrix<double, 6, 1> PoseVector;
+typedef Eigen::Matrix<double, 2, 6> PoseJacobian;
+
+//ViewSystem structure for the normal equations terms of a frame
+struct ViewSystem
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  CameraMatrix cameraCamera;
+  CameraPoseMatrix cameraPose;
+  PoseMatrix posePose;
+  CameraVector cameraGradient;
+  PoseVector poseGradient;
+
+  //Schur complement terms, with the damped pose block inverse
+  CameraPoseMatrix cameraPoseInvPose;
+  PoseMatrix invPosePose;
+};
+
+typedef std::vector<ViewSystem, Eigen::aligned_allocator<ViewSystem> > ViewSystems;
+
+//Pose structure for a trial pose of a frame
+struct Pose
+{
+  openMVG::Mat3 rotation;
+  openMVG::Vec3 translation;
+};
+
+double computeSquaredError(EParamLensModel model, const CameraParams &camera, const CalibrationView &view, const Pose &pose)
+{
+  double squaredError = 0.0;
+  openMVG::Vec2 pixel;
+  for(std::size_t i = 0; i < view.objectPoints.size(); ++i)
+  {
+    const cv::Point3f &objectPoint = view.objectPoints[i];
+    const openMVG::Vec3 point = pose.rotation * openMVG::Vec3(objectPoint.x, objectPoint.y, objectPoint.z) + pose.translation;
+    projectPoint(model, camera, point, pixel, nullptr, nullptr);
+    squaredError += (pixel - openMVG::Vec2(view.imagePoints[i].x, view.imagePoints[i].y)).squaredNorm();
+  }
+  return squaredError;
+}
+
+/**
+ * @brief Build the normal equations terms of a frame
+ * The pose is updated by a rotation vector applied on the left and a translation.
+ */
+void buildViewSystem(EParamLensModel model, const CameraParams &camera, CalibrationView &view, ViewSystem &system)
+{
+  system.cameraCamera.setZero();
+  system.cameraPose.setZero();
+  system.posePose.setZero();
+  system.cameraGradient.setZero();
+  system.poseGradient.setZero();
+  view.squaredError = 0.0;
+
+  openMVG::Vec2 pixel;
+  CameraJacobian dCamera;
+  PointJacobian dPoint;
+  PoseJacobian dPose;
+
+  for(std::size_t i = 0; i < view.objectPoints.size(); ++i)
+  {
+    const cv::Point3f &objectPoint = view.objectPoints[i];
+    const openMVG::Vec3 rotated = view.rotation * openMVG::Vec3(objectPoint.x, objectPoint.y, objectPoint.z);
+    projectPoint(model, camera, rotated + view.translation, pixel, &dCamera, &dPoint);
+
+    //d(exp(w) R X) / dw = -[R X]x
+    dPose.leftCols<3>() << dPoint(0, 2) * rotated(1) - dPoint(0, 1) * rotated(2),
+                           dPoint(0, 0) * rotated(2) - dPoint(0, 2) * rotated(0),
+                           dPoint(0, 1) * rotated(0) - dPoint(0, 0) * rotated(1),
+                           dPoint(1, 2) * rotated(1) - dPoint(1, 1) * rotated(2),
+                           dPoint(1, 0) * rotated(2) - dPoint(1, 2) * rotated(0),
+                           dPoint(1, 1) * rotated(0) - dPoint(1, 0) * rotated(1);
+    dPose.rightCols<3>() = dPoint;
+
+    const openMVG::Vec2 residual = pixel - openMVG::Vec2(view.imagePoints[i].x, view.imagePoints[i].y);
+    system.cameraCamera.noalias() += dCamera.transpose() * dCamera;
+    system.cameraPose.noalias() += dCamera.transpose() * dPose;
+    system.posePose.noalias() += dPose.transpose() * dPose;
+    system.cameraGradient.noalias() += dCamera.transpose() * residual;
+    system.poseGradient.noalias() += dPose.transpose() * residual;
+    view.squaredError += residual.squaredNorm();
+  }
+}
+
+inline openMVG::Mat3 getRotation(const openMVG::Vec3 &rotationVector)
+{
+  const double angle = rotationVector.norm();
+  if(angle < std::numeric_limits<double>::epsilon())
+    return openMVG::Mat3::Identity();
+  return Eigen::AngleAxisd(angle, rotationVector / angle).toRotationMatrix();
+}
+
+} //namespace
+
+double CalibrationView::getError() const
+{
+  return objectPoints.empty() ? 0.0 : std::sqrt(squaredError / objectPoints.size());
+}
+
+void initializeCalibration(const cv::Size &imageSize, CalibrationProblem &problem)
+{
+  std::vector<std::vector<cv::Point3f> > objectPoints;
+  std::vector<std::vector<cv::Point2f> > imagePoints;
+  for(const CalibrationView &view : problem.views)
+  {
+    objectPoints.push_back(view.objectPoints);
+    imagePoints.push_back(view.imagePoints);
+  }
+
+  const cv::Mat cameraMatrix = cv::initCameraMatrix2D(objectPoints, imagePoints, imageSize);
+  problem.camera.fill(0.0);
+  problem.camera[0] = cameraMatrix.at<double>(0, 0);
+  problem.camera[1] = cameraMatrix.at<double>(1, 1);
+  problem.camera[2] = cameraMatrix.at<double>(0, 2);
+  problem.camera[3] = cameraMatrix.at<double>(1, 2);
+
+  const cv::Mat distCoeffs = cv::Mat::zeros(5, 1, CV_64F);
+  Common::parallelFor(problem.views.size(), 0, [&](std::size_t i)
+  {
+    CalibrationView &view = problem.views[i];
+    cv::Mat rvec;
+    cv::Mat tvec;
+    cv::solvePnP(view.objectPoints, view.imagePoints, cameraMatrix, distCoeffs, rvec, tvec);
+    cv::Mat rotation;
+    cv::Rodrigues(rvec, rotation);
+    for(int row = 0; row < 3; ++row)
+    {
+      for(int col = 0; col < 3; ++col)
+        view.rotation(row, col) = rotation.at<double>(row, col);
+      view.translation(row) = tvec.at<double>(row);
+    }
+  });
+}
+
+double refineCalibration(CalibrationProblem &problem, std::size_t maxIterations, const std::function<bool()> &keepGoing)
+{
+  std::vector<CalibrationView> &views = problem.views;
+  std::size_t nbPoints = 0;
+  for(const CalibrationView &view : views)
+    nbPoints += view.objectPoints.size();
+  if(nbPoints == 0)
+    return 0.0;
+
+  ViewSystems systems(views.size());
+  std::vector<Pose> trialPoses(views.size());
+  std::vector<double> trialErrors(views.size());
+  std::vector<CameraMatrix, Eigen::aligned_allocator<CameraMatrix> > schurTerms(views.size());
+  std::vector<CameraVector, Eigen::aligned_allocator<CameraVector> > schurGradients(views.size());
+
+  auto buildSystems = [&]()
+  {
+    Common::parallelFor(views.size(), 0, [&](std::size_t i) { buildViewSystem(problem.model, problem.camera, views[i], systems[i]); });
+    double cost = 0.0;
+    for(const CalibrationView &view : views)
+      cost += view.squaredError;
+    return cost;
+  };
+
+  double cost = buildSystems();
+  double lambda = 1e-3;
+
+  for(std::size_t iteration = 0; iteration < maxIterations && keepGoing(); ++iteration)
+  {
+    //Eliminate the poses, Marquardt damping on the diagonals
+    Common::parallelFor(views.size(), 0, [&](std::size_t i)
+    {
+      ViewSystem &system = systems[i];
+      PoseMatrix damped = system.posePose;
+      damped.diagonal() += lambda * system.posePose.diagonal().cwiseMax(1e-12);
+      system.invPosePose = damped.inverse();
+      system.cameraPoseInvPose.noalias() = system.cameraPose * system.invPosePose;
+      schurTerms[i].noalias() = system.cameraPoseInvPose * system.cameraPose.transpose();
+      schurGradients[i].noalias() = system.cameraPoseInvPose * system.poseGradient;
+    });
+
+    CameraMatrix reduced = CameraMatrix::Zero();
+    CameraVector reducedGradient = CameraVector::Zero();
+    for(std::size_t i = 0; i < views.size(); ++i)
+    {
+      reduced += systems[i].cameraCamera - schurTerms[i];
+      reducedGradient += systems[i].cameraGradient - schurGradients[i];
+    }
+    CameraVector diagonal = CameraVector::Zero();
+    for(const ViewSystem &system : systems)
+      diagonal += system.cameraCamera.diagonal();
+    reduced.diagonal() += lambda * diagonal.cwiseMax(1e-12);
+
+    for(std::size_t p = 0; p < kNbCameraParams; ++p)
+    {
+      if(!problem.isConstant[p])
+        continue;
+      reduced.row(p).setZero();
+      reduced.col(p).setZero();
+      reduced(p, p) = 1.0;
+      reducedGradient(p) = 0.0;
+    }
+
+    const CameraVector cameraStep = -reduced.ldlt().solve(reducedGradient);
+    CameraParams trialCamera = problem.camera;
+    for(std::size_t p = 0; p < kNbCameraParams; ++p)
+    {
+      if(!problem.isConstant[p])
+        trialCamera[p] += cameraStep(p);
+    }
+
+    Common::parallelFor(views.size(), 0, [&](std::size_t i)
+    {
+      const ViewSystem &system = systems[i];
+      const PoseVector poseStep = -system.invPosePose * (system.poseGradient + system.cameraPose.transpose() * cameraStep);
+      trialPoses[i].rotation = getRotation(poseStep.head<3>()) * views[i].rotation;
+      trialPoses[i].translation = views[i].translation + poseStep.tail<3>();
+      trialErrors[i] = computeSquaredError(problem.model, trialCamera, views[i], trialPoses[i]);
+    });
+
+    double trialCost = 0.0;
+    for(double error : trialErrors)
+      trialCost += error;
+
+    if(!(trialCost < cost))
+    {
+      lambda *= 10.0;
+      if(lambda > 1e16)
+        break;
+      continue;
+    }
+
+    problem.camera = trialCamera;
+    for(std::size_t i = 0; i < views.size(); ++i)
+    {
+      views[i].rotation = trialPoses[i].rotation;
+      views[i].translation = trialPoses[i].translation;
+    }
+    lambda = std::max(lambda * 0.1, 1e-12);
+
+    const double decrease = cost - trialCost;
+    cost = buildSystems();
+    if(decrease <= 1e-12 * cost)
+      break;
+  }
+  return std::sqrt(cost / nbPoints);
+}
+
+} //namespace LensCalibration
+} //namespace openMVG_ofx
@@ -0,0 +1,62 @@
+#pragma once
+#include "LensCalibrationModel.hpp"
+
+#include <openMVG/numeric/numeric.h>
+
+#include <opencv2/core/core.hpp>
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+namespace openMVG_ofx {
+namespace LensCalibration {
+
+//CalibrationView structure for a frame of the calibration and its pattern pose
+struct CalibrationView
+{
+  std::vector<cv::Point3f> objectPoints;
+  std::vector<cv::Point2f> imagePoints;
+  openMVG::Mat3 rotation = openMVG::Mat3::Identity(); //pattern to camera
+  openMVG::Vec3 translation = openMVG::Vec3::Zero();
+  double squaredError = 0.0;                          //sum on the points, set by refineCalibration
+
+  /**
+   * @brief Root mean square reprojection error of the frame
+   */
+  double getError() const;
+};
+
+//CalibrationProblem structure for the camera and the frames solved together
+struct CalibrationProblem
+{
+  EParamLensModel model = eParamLensModelRadialK3;
+  CameraParams camera;
+  std::array<bool, kNbCameraParams> isConstant;
+  std::vector<CalibrationView> views;
+};
+
+/**
+ * @brief Initialize the camera from the pattern homographies and the poses with PnP
+ * The distortion coefficients are set to zero. The poses are computed in parallel.
+ * @param[in] imageSize
+ * @param[in,out] problem - views with their points
+ */
+void initializeCalibration(const cv::Size &imageSize, CalibrationProblem &problem);
+
+/**
+ * @brief Refine the camera and the poses with Levenberg-Marquardt
+ * Starts from the current problem values, so a problem solved before converges
+ * in a few iterations. The normal equations of the frames are built in parallel
+ * and the poses are eliminated with the Schur complement, only the camera block
+ * is solved densely.
+ * @param[in,out] problem - the constant camera parameters aren't changed
+ * @param[in] maxIterations
+ * @param[in] keepGoing - checked between iterations, returns false to stop
+ * @return the root mean square reprojection error
+ */
+double refineCalibration(CalibrationProblem &problem, std::size_t maxIterations, const std::function<bool()> &keepGoing);
+
+} //namespace LensCalibration
+} //namespace openMVG_ofx
@@ -1,44 +1,338 @@
 #include "CameraLocalizer.hpp"
+#include "../common/ThreadPool.hpp"
 
 #include <nonFree/sift/SIFT_describer.hpp>
 
 #include <cmath>
+#include <cassert>
 #include <chrono>
+#include <algorithm>
 
 namespace openMVG_ofx {
 namespace Localizer {
 
+namespace {
+
+//SharedVLFeatStateGuard structure holding the VLFeat state lock in shared mode
+struct SharedVLFeatStateGuard
+{
+  VLFeatStateLock &lock;
+
+  explicit SharedVLFeatStateGuard(VLFeatStateLock &lock)
+    : lock(lock)
+  {
+    lock.lock_shared();
+  }
+
+  ~SharedVLFeatStateGuard()
+  {
+    lock.unlock_shared();
+  }
+};
+
+//SIFTDescriberPool structure for the idle describers of all the plugin instances
+//They are never destroyed, as their destructor tears down the VLFeat state (vl_destructor)
+struct SIFTDescriberPool
+{
+  std::mutex mutex;
+  std::vector<openMVG::features::SIFT_Image_describer*> describers;
+};
+
+SIFTDescriberPool& getSIFTDescriberPool()
+{
+  static SIFTDescriberPool *pool = new SIFTDescriberPool();
+  return *pool;
+}
+
+//SIFTDescriberLease structure for describers taken from the pool, given back when destroyed
+struct SIFTDescriberLease
+{
+  std::vector<openMVG::features::SIFT_Image_describer*> describers;
+
+  explicit SIFTDescriberLease(std::size_t nbDescribers)
+  {
+    SIFTDescriberPool &pool = getSIFTDescriberPool();
+    {
+      std::lock_guard<std::mutex> guard(pool.mutex);
+      while(describers.size() < nbDescribers && !pool.describers.empty())
+      {
+        describers.push_back(pool.describers.back());
+        pool.describers.pop_back();
+      }
+    }
+    if(describers.size() < nbDescribers)
+    {
+      std::lock_guard<VLFeatStateLock> guard(getVLFeatStateLock());
+      while(describers.size() < nbDescribers)
+        describers.push_back(new openMVG::features::SIFT_Image_describer());
+    }
+  }
+
+  ~SIFTDescriberLease()
+  {
+    SIFTDescriberPool &pool = getSIFTDescriberPool();
+    std::lock_guard<std::mutex> guard(pool.mutex);
+    pool.describers.insert(pool.describers.end(), describers.begin(), describers.end());
+  }
+};
+
+} //namespace
+
+void VLFeatStateLock::lock()
+{
+  std::unique_lock<std::mutex> guard(_mutex);
+  ++_nbExclusiveWaiting;
+  _released.wait(guard, [this]() { return !_exclusive && _nbShared == 0; });
+  --_nbExclusiveWaiting;
+  _exclusive = true;
+}
+
+void VLFeatStateLock::unlock()
+{
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _exclusive = false;
+  }
+  _released.notify_all();
+}
+
+void VLFeatStateLock::lock_shared()
+{
+  std::unique_lock<std::mutex> guard(_mutex);
+  _released.wait(guard, [this]() { return !_exclusive && _nbExclusiveWaiting == 0; });
+  ++_nbShared;
+}
+
+void VLFeatStateLock::unlock_shared()
+{
+  bool isLast;
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    isLast = (--_nbShared == 0);
+  }
+  if(isLast)
+    _released.notify_all();
+}
+
+VLFeatStateLock& getVLFeatStateLock()
+{
+  //Never destroyed, the localizers can be released after the static destructors
+  static VLFeatStateLock *lock = new VLFeatStateLock();
+  return *lock;
+}
+
+void deleteLocalizer(openMVG::localization::ILocalizer *localizer)
+{
+  std::lock_guard<VLFeatStateLock> guard(getVLFeatStateLock());
+  delete localizer;
+  //The describer of the localizer tore down the VLFeat state, the pooled describers still use it
+  vl_constructor();
+}
+
 void LocalizerProcessData::extractFeatures(
       const std::map< std::size_t, openMVG::image::Image<unsigned char> > &mapImageGray,
-      std::vector< std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions) const
+      std::vector< std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions,
+      std::size_t nbThreads) const
+{
+  std::vector<const openMVG::image::Image<unsigned char>*> vecImageGray;
+  for(const auto &inputImageGrey : mapImageGray)
+  {
+    vecImageGray.push_back(&inputImageGrey.second);
+  }
+  
+  std::vector<std::chrono::milliseconds> vecElapsed(vecImageGray.size());
+  
+  std::cout << "[features]\tExtract SIFT : " << vecImageGray.size() << " input(s)" << std::endl;
+  
+  //One describer per input, taken on this thread before the parallel region
+  SIFTDescriberLease lease(vecImageGray.size());
+  for(openMVG::features::SIFT_Image_describer *imageDescriber : lease.describers)
+  {
+    imageDescriber->Set_configuration_preset(param->_featurePreset);
+  }
+  
+  {
+    SharedVLFeatStateGuard guard(getVLFeatStateLock());
+    
+    //Each input is written at its own index, so the output order doesn't depend on scheduling
+    Common::parallelFor(vecImageGray.size(), nbThreads, [&](std::size_t i)
+    {
+      auto detect_start = std::chrono::steady_clock::now();
+      lease.describers[i]->Describe(*vecImageGray[i], vecQueryRegions[i], nullptr);
+      auto detect_end = std::chrono::steady_clock::now();
+      vecElapsed[i] = std::chrono::duration_cast<std::chrono::milliseconds>(detect_end - detect_start);
+    });
+  }
+  
+  for(std::size_t i = 0; i < vecImageGray.size(); ++i)
+  {
+    std::cout << "[features]\tExtract SIFT done: input " << i << " found " << vecQueryRegions[i]->RegionCount() << " features in " << vecElapsed[i].count() << " [ms]" << std::endl;
+  }
+}
+
+void LocalizerProcessData::localizeFrame(openMVG::localization::ILocalizer &localizer,
+                                         const std::map< std::size_t, openMVG::image::Image<unsigned char> > &mapImageGray,
+                                         FrameQuery &query,
+                                         std::size_t nbThreads,
+                                         std::vector<openMVG::localization::LocalizationResult> &vecLocResults,
+                                         std::vector< std::vector<openMVG::features::SIOPointFeature> > &vecFeatures,
+                                         FrameTracking *tracking)
 {
-  openMVG::features::SIFT_Image_describer imageDescriber;
-  imageDescriber.Set_configuration_preset(param->_featurePreset);
+  const std::size_t nbInputs = mapImageGray.size();
   
-  auto inputImageGrey = mapImageGray.begin();
+  //Optical flow tracking, the features are only extracted on keyframes
+  std::vector< std::vector<cv::Mat> > vecPyramids;
+  if(tracking && tracking->param.useOpticalFlow && !query.useRig)
+  {
+    std::vector<const openMVG::image::Image<unsigned char>*> vecImageGray;
+    for(const auto &inputImageGrey : mapImageGray)
+    {
+      vecImageGray.push_back(&inputImageGrey.second);
+    }
+    
+    vecPyramids.resize(nbInputs);
+    Common::parallelFor(nbInputs, nbThreads, [&](std::size_t input)
+    {
+      buildTrackingPyramid(*vecImageGray[input], tracking->param, vecPyramids[input]);
+    });
     
-  for(unsigned int i = 0; i < mapImageGray.size(); ++i)
+    //All the inputs must be tracked, otherwise the frame is a keyframe
+    std::vector<openMVG::localization::LocalizationResult> vecTrackedResults(nbInputs);
+    std::vector< std::vector<openMVG::features::SIOPointFeature> > vecTrackedFeatures(nbInputs);
+    std::vector< std::vector<openMVG::features::SIFT_Regions::DescriptorT> > vecTrackedDescriptors(nbInputs);
+    bool isTracked = (tracking->priors.size() == nbInputs);
+    for(std::size_t input = 0; isTracked && input < nbInputs; ++input)
+    {
+      isTracked = (tracking->priors[input].time == query.time - 1.0) &&
+                  localizeFromOpticalFlow(tracking->priors[input],
+                                          vecPyramids[input],
+                                          query.vecImageSize[input],
+                                          tracking->param,
+                                          query.vecHasIntrinsics[input],
+                                          query.vecIntrinsics[input],
+                                          vecTrackedResults[input],
+                                          vecTrackedFeatures[input],
+                                          vecTrackedDescriptors[input]);
+    }
+    
+    if(isTracked)
+    {
+      for(std::size_t input = 0; input < nbInputs; ++input)
+      {
+        updateTrackingPrior(query.time, query.vecImageSize[input], vecTrackedResults[input], vecTrackedFeatures[input], vecTrackedDescriptors[input], tracking->priors[input]);
+        tracking->priors[input].pyramid = std::move(vecPyramids[input]);
+      }
+      vecLocResults = std::move(vecTrackedResults);
+      vecFeatures = std::move(vecTrackedFeatures);
+      return;
+    }
+    std::cout << "[tracking]\tnew keyframe at frame " << query.time << std::endl;
+  }
+  
+  std::vector< std::unique_ptr<openMVG::features::Regions> > vecQueryRegions(nbInputs);
+  
+  //Extract features
+  extractFeatures(mapImageGray, vecQueryRegions, nbThreads);
+  
+  localizeRegions(localizer, vecQueryRegions, query, vecLocResults, vecFeatures, tracking);
+  
+  //Keyframe pyramids for the next frame
+  for(std::size_t input = 0; input < vecPyramids.size(); ++input)
+  {
+    tracking->priors[input].pyramid = std::move(vecPyramids[input]);
+  }
+}
+
+void LocalizerProcessData::localizeRegions(openMVG::localization::ILocalizer &localizer,
+                                           std::vector< std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions,
+                                           FrameQuery &query,
+                                           std::vector<openMVG::localization::LocalizationResult> &vecLocResults,
+                                           std::vector< std::vector<openMVG::features::SIOPointFeature> > &vecFeatures,
+                                           FrameTracking *tracking)
+{
+  const std::size_t nbInputs = vecQueryRegions.size();
+  
+  //Localization Process
+  if(query.useRig)
   {
-    std::cout << "[features]\tExtract SIFT : input " << i << std::endl;
-    // outQueryRegions.reset(new openMVG::features::SIFT_Regions());
+    std::cout << "[localization]\tKnown RIG" << std::endl;
+    openMVG::geometry::Pose3 mainCameraPose;
     
-    auto detect_start = std::chrono::steady_clock::now();
-    imageDescriber.Describe( inputImageGrey->second, vecQueryRegions[i], nullptr);
-    ++inputImageGrey;
+    localizeRig(localizer,
+                vecQueryRegions,
+                query.vecImageSize,
+                query.vecIntrinsics,
+                query.vecSubPoses,
+                mainCameraPose,
+                vecLocResults);
     
-    auto detect_end = std::chrono::steady_clock::now();
-    auto detect_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(detect_end - detect_start);
-    std::cout << "[features]\tExtract SIFT done: found " << vecQueryRegions[i]->RegionCount() << " features in " << detect_elapsed.count() << " [ms]" << std::endl;
+    //Missing results are invalid
+    vecLocResults.resize(nbInputs);
+  }
+  else
+  {
+    if(nbInputs > 1)
+      std::cout << "[localization]\tSimple mode : unknown RIG" << std::endl;
+    else
+      std::cout << "[localization]\tSimple mode : one camera" << std::endl;
+    
+    vecLocResults.resize(nbInputs);
+    for(std::size_t input = 0; input < nbInputs; ++input)
+    {
+      //Track from the previous frame, the global localization is the fallback
+      const openMVG::features::SIFT_Regions *siftRegions = dynamic_cast<const openMVG::features::SIFT_Regions*>(vecQueryRegions[input].get());
+      if(tracking && siftRegions &&
+         (input < tracking->priors.size()) &&
+         (tracking->priors[input].time == query.time - 1.0) &&
+         localizeFromPrior(tracking->priors[input],
+                           *siftRegions,
+                           query.vecImageSize[input],
+                           tracking->param,
+                           query.vecHasIntrinsics[input],
+                           query.vecIntrinsics[input],
+                           vecLocResults[input]))
+      {
+        continue;
+      }
+      
+      localize(localizer,
+               vecQueryRegions[input],
+               query.vecImageSize[input],
+               query.vecHasIntrinsics[input],
+               query.vecIntrinsics[input],
+               vecLocResults[input]);
+    }
+  }
+  
+  //Keep the frame inliers for the next frame
+  if(tracking)
+  {
+    tracking->priors.resize(nbInputs);
+    for(std::size_t input = 0; input < nbInputs; ++input)
+    {
+      const openMVG::features::SIFT_Regions *siftRegions = dynamic_cast<const openMVG::features::SIFT_Regions*>(vecQueryRegions[input].get());
+      if(siftRegions)
+        updateTrackingPrior(query.time, query.vecImageSize[input], vecLocResults[input], siftRegions->Features(), siftRegions->Descriptors(), tracking->priors[input]);
+      else
+        tracking->priors[input] = TrackingPrior();
+    }
+  }
+  
+  vecFeatures.resize(nbInputs);
+  for(std::size_t input = 0; input < nbInputs; ++input)
+  {
+    vecFeatures[input] = dynamic_cast<const openMVG::features::SIFT_Regions*>(vecQueryRegions[input].get())->Features();
   }
 }
 
-bool LocalizerProcessData::localize(std::unique_ptr<openMVG::features::Regions> &queryRegions,
+bool LocalizerProcessData::localize(openMVG::localization::ILocalizer &localizer,
+                                    std::unique_ptr<openMVG::features::Regions> &queryRegions,
                                     const std::pair<std::size_t, std::size_t> &queryImageSize,
                                     bool hasIntrinsics,
                                     openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &queryIntrinsics,
                                     openMVG::localization::LocalizationResult &localizationResult)
 {
-  return localizer->localize(queryRegions,
+  return localizer.localize(queryRegions,
                   queryImageSize,
                   this->param.get(),
                   hasIntrinsics,
@@ -47,7 +341,8 @@ bool LocalizerProcessData::localize(std::unique_ptr<openMVG::features::Regions>
                   "");
 }
                                     
-bool LocalizerProcessData::localizeRig(const std::vector<std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions,
+bool LocalizerProcessData::localizeRig(openMVG::localization::ILocalizer &localizer,
+                                        const std::vector<std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions,
                                         const std::vector<std::pair<std::size_t, std::size_t> > &vecQueryImageSize,
                                         std::vector<openMVG::cameras::Pinhole_Intrinsic_Radial_K3 > &vecQueryIntrinsics,
                                         const std::vector<openMVG::geometry::Pose3 > &vecQuerySubPoses,
@@ -55,7 +350,7 @@ bool LocalizerProcessData::localizeRig(const std::vector<std::unique_ptr<openMVG
                                         std::vector<openMVG::localization::LocalizationResult> &vecLocResults)
 {
   
-  return localizer->localizeRig(vecQueryRegions,
+  return localizer.localizeRig(vecQueryRegions,
                                 vecQueryImageSize,
                                 this->param.get(),
                                 vecQueryIntrinsics,
@@ -212,47 +507,94 @@ void setStatToParamsAtTime(
   outputStatNbInlierFeatures->setValueAtTime(time, localizationResult.getInliers().size());
 }
 
-void convertRGB32ToGRAY8(const Common::Image<float> &inputImage, openMVG::image::Image<unsigned char> &outputImage)
+void convertGRAY8ToRGB32(openMVG::image::Image<unsigned char> &inputImage, const Common::Image<float>& outputImage)
 {
-  for(unsigned int y = 0; y < outputImage.Height(); ++y)
+  for(unsigned int y = 0; y < inputImage.Height(); ++y)
   {
-    for(unsigned int x = 0; x < outputImage.Width(); ++x)
+    for(unsigned int x = 0; x < inputImage.Width(); ++x)
     {
-      const float* rgbPtr = inputImage.getPixel(x, y);
-      const float gray = openMVG::image::Rgb2Gray(rgbPtr[0], rgbPtr[1], rgbPtr[2]);
-      outputImage(y, x) = (unsigned char)(gray * 255.f);
+      const float gray = float(inputImage(y, x)) / 255.f;
+      float* rgbPtr = outputImage.getPixel(x, y);
+      rgbPtr[0] = gray;
+      rgbPtr[1] = gray;
+      rgbPtr[2] = gray;
     }
   }
 }
+  
 
-void convertGGG32ToGRAY8(const Common::Image<float> &inputImage, openMVG::image::Image<unsigned char> &outputImage)
+void downscaleGRAY8(const openMVG::image::Image<unsigned char> &inputImage, std::size_t factor, openMVG::image::Image<unsigned char> &outputImage)
 {
-  for(unsigned int y = 0; y < outputImage.Height(); ++y)
+  assert(factor > 0);
+  const std::size_t width = inputImage.Width() / factor;
+  const std::size_t height = inputImage.Height() / factor;
+  const unsigned int area = factor * factor;
+  
+  outputImage = openMVG::image::Image<unsigned char>(width, height);
+  std::vector<unsigned int> rowSums(width);
+  
+  for(std::size_t y = 0; y < height; ++y)
   {
-    for(unsigned int x = 0; x < outputImage.Width(); ++x)
+    std::fill(rowSums.begin(), rowSums.end(), 0);
+    for(std::size_t blockY = 0; blockY < factor; ++blockY)
+    {
+      const unsigned char *inputRow = &inputImage(y * factor + blockY, 0);
+      for(std::size_t x = 0; x < width; ++x)
+      {
+        for(std::size_t blockX = 0; blockX < factor; ++blockX)
+        {
+          rowSums[x] += *inputRow++;
+        }
+      }
+    }
+    
+    unsigned char *outputRow = &outputImage(y, 0);
+    for(std::size_t x = 0; x < width; ++x)
     {
-      const float* rgbPtr = inputImage.getPixel(x, y);
-      const float gray = rgbPtr[0];
-      outputImage(y, x) = (unsigned char)(gray * 255.f);
+      outputRow[x] = static_cast<unsigned char>((rowSums[x] + area / 2) / area);
     }
   }
 }
 
-void convertGRAY8ToRGB32(openMVG::image::Image<unsigned char> &inputImage, const Common::Image<float>& outputImage)
+openMVG::cameras::Pinhole_Intrinsic_Radial_K3 rescaleIntrinsics(const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &intrinsics, double scale)
 {
-  for(unsigned int y = 0; y < inputImage.Height(); ++y)
+  //Radial distortion applies on normalized coordinates, it doesn't change
+  const std::vector<double> params = intrinsics.getParams();
+  return openMVG::cameras::Pinhole_Intrinsic_Radial_K3(
+    static_cast<int>(std::round(intrinsics.w() * scale)),
+    static_cast<int>(std::round(intrinsics.h() * scale)),
+    params[0] * scale, 
+    params[1] * scale, 
+    params[2] * scale, 
+    params[3], 
+    params[4], 
+    params[5]);
+}
+
+openMVG::localization::LocalizationResult rescaleLocalizationResult(const openMVG::localization::LocalizationResult &localizationResult, double scale)
+{
+  openMVG::sfm::Image_Localizer_Match_Data matchData = localizationResult.getMatchData();
+  matchData.pt2D *= scale;
+  matchData.error_max *= scale;
+  matchData.projection_matrix.topRows(2) *= scale;
+  
+  return openMVG::localization::LocalizationResult(matchData,
+                                                   localizationResult.getIndMatch3D2D(),
+                                                   localizationResult.getPose(),
+                                                   rescaleIntrinsics(localizationResult.getIntrinsics(), scale),
+                                                   localizationResult.getMatchedImages(),
+                                                   localizationResult.isValid());
+}
+
+void rescaleFeatures(double scale, std::vector<openMVG::features::SIOPointFeature> &features)
+{
+  for(openMVG::features::SIOPointFeature &feature : features)
   {
-    for(unsigned int x = 0; x < inputImage.Width(); ++x)
-    {
-      const float gray = float(inputImage(y, x)) / 255.f;
-      float* rgbPtr = outputImage.getPixel(x, y);
-      rgbPtr[0] = gray;
-      rgbPtr[1] = gray;
-      rgbPtr[2] = gray;
-    }
+    feature.x() *= scale;
+    feature.y() *= scale;
+    feature.scale() *= scale;
   }
 }
-  
 
 } //namespace Localizer
-} //namespace openMVG_ofx
\ No newline at end of file
+} //namespace openMVG_ofx
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "CameraLocalizerPluginDefinition.hpp"
+#include "CameraLocalizerTracking.hpp"
 #include "../common/Image.hpp"
 
 #include <openMVG/localization/ILocalizer.hpp>
@@ -15,6 +16,7 @@
 #include <openMVG/image/image_io.hpp>
 #include <openMVG/dataio/FeedProvider.hpp>
 
+#include <condition_variable>
 #include <memory>
 #include <mutex>
 
@@ -73,24 +75,118 @@ struct FrameData
 };
 
 
+//FrameQuery structure for the localization inputs of one frame
+struct FrameQuery
+{
+  double time = 0.0;
+  std::vector<bool> vecHasIntrinsics;
+  std::vector<openMVG::cameras::Pinhole_Intrinsic_Radial_K3> vecIntrinsics; //TODO : Change for different camera type
+  std::vector<std::pair<std::size_t, std::size_t> > vecImageSize;
+  std::vector<openMVG::geometry::Pose3> vecSubPoses; //Don't save main camera
+  bool useRig = false;
+};
+
+
+/**
+ * @brief Lock guarding the VLFeat state of the process
+ * The SIFT describer constructor and destructor set up and tear down the VLFeat
+ * state of the whole process (vl_constructor / vl_destructor), and the localizer
+ * databases own a describer too. They run under the exclusive lock, while
+ * Describe() calls share the lock. Waiting exclusive lockers go first.
+ */
+class VLFeatStateLock
+{
+public:
+  void lock();
+  void unlock();
+  void lock_shared();
+  void unlock_shared();
+
+private:
+  std::mutex _mutex;
+  std::condition_variable _released;
+  std::size_t _nbShared = 0;
+  std::size_t _nbExclusiveWaiting = 0;
+  bool _exclusive = false;
+};
+
+/**
+ * @brief Get the lock guarding the VLFeat state, shared by all the plugin instances
+ * @return the lock
+ */
+VLFeatStateLock& getVLFeatStateLock();
+
+/**
+ * @brief Delete a localizer database under the exclusive VLFeat state lock
+ * The VLFeat state torn down by the describer of the localizer is set up again.
+ * @param[in] localizer
+ */
+void deleteLocalizer(openMVG::localization::ILocalizer *localizer);
+
+
 //ProcessData structure for localization process
 struct LocalizerProcessData
 {
   std::vector<openMVG::cameras::Pinhole_Intrinsic_Radial_K3> queryIntrinsics;
   std::unique_ptr<openMVG::localization::LocalizerParameters> param;
-  std::unique_ptr<openMVG::localization::ILocalizer> localizer;
   
+  /**
+   * @brief Extract SIFT features of each input image
+   * @param[in] mapImageGray
+   * @param[out] vecQueryRegions - one entry per input, in mapImageGray order
+   * @param[in] nbThreads - number of inputs processed concurrently, 0 for automatic
+   */
   void extractFeatures(
       const std::map< std::size_t, openMVG::image::Image<unsigned char> > &mapImageGray,
-      std::vector< std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions) const;
+      std::vector< std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions,
+      std::size_t nbThreads) const;
 
-  bool localize(std::unique_ptr<openMVG::features::Regions>& queryRegions,
+  /**
+   * @brief Extract features and localize all the inputs of one frame
+   * Only reads the localizer database, so several frames can be localized concurrently
+   * if they don't share the tracking state.
+   * @param[in] localizer - the localizer database, shared between instances, see getSharedLocalizerAsync
+   * @param[in] mapImageGray
+   * @param[in,out] query
+   * @param[in] nbThreads - number of threads used for the features extraction
+   * @param[out] vecLocResults - one entry per input, in mapImageGray order
+   * @param[out] vecFeatures - one entry per input, in mapImageGray order
+   * @param[in,out] tracking - if not null, inputs localized at the previous frame are tracked
+   */
+  void localizeFrame(openMVG::localization::ILocalizer &localizer,
+                     const std::map< std::size_t, openMVG::image::Image<unsigned char> > &mapImageGray,
+                     FrameQuery &query,
+                     std::size_t nbThreads,
+                     std::vector<openMVG::localization::LocalizationResult> &vecLocResults,
+                     std::vector< std::vector<openMVG::features::SIOPointFeature> > &vecFeatures,
+                     FrameTracking *tracking = nullptr);
+  
+  /**
+   * @brief Localize all the inputs of one frame from their extracted features
+   * @see localizeFrame
+   * @param[in] localizer
+   * @param[in] vecQueryRegions - one entry per input
+   * @param[in,out] query
+   * @param[out] vecLocResults - one entry per input
+   * @param[out] vecFeatures - one entry per input
+   * @param[in,out] tracking - if not null, inputs localized at the previous frame are tracked
+   */
+  void localizeRegions(openMVG::localization::ILocalizer &localizer,
+                       std::vector< std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions,
+                       FrameQuery &query,
+                       std::vector<openMVG::localization::LocalizationResult> &vecLocResults,
+                       std::vector< std::vector<openMVG::features::SIOPointFeature> > &vecFeatures,
+                       FrameTracking *tracking = nullptr);
+
+  bool localize(openMVG::localization::ILocalizer &localizer,
+                std::unique_ptr<openMVG::features::Regions>& queryRegions,
                 const std::pair<std::size_t, std::size_t>& queryImageSize,
                 bool hasIntrinsics,  
                 openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &queryIntrinsics,
                 openMVG::localization::LocalizationResult &localizationResult);
 
-  bool localizeRig(const std::vector<std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions,
+  bool localizeRig(openMVG::localization::ILocalizer &localizer,
+                                        const std::vector<std::unique_ptr<openMVG::features::Regions> > &vecQueryRegions,
                                         const std::vector<std::pair<std::size_t, std::size_t> > &vecQueryImageSize,
                                         std::vector<openMVG::cameras::Pinhole_Intrinsic_Radial_K3 > &vecQueryIntrinsics,
                                         const std::vector<openMVG::geometry::Pose3 > &vecQuerySubPoses,
@@ -191,25 +287,42 @@ void setStatToParamsAtTime(
     OFX::DoubleParam *outputStatNbInlierFeatures);
 
 /**
- * @brief convert a 32 bits float image to a gray (unsigned char) 8 bits image
+ * @brief convert a gray (unsigned char) 8 bits image to a 32 bits float image
  * @param inputImage
  * @param outputImage
  */
-void convertRGB32ToGRAY8(const Common::Image<float>& inputImage, openMVG::image::Image<unsigned char> &outputImage);
+void convertGRAY8ToRGB32(openMVG::image::Image<unsigned char> &inputImage, const Common::Image<float>& outputImage);
 
 /**
- * @brief convert a 32 bits float grayscale image to an (unsigned char) 8 bits image
+ * @brief downscale a gray (unsigned char) 8 bits image by averaging blocks of factor x factor pixels
  * @param inputImage
+ * @param factor
  * @param outputImage
  */
-void convertGGG32ToGRAY8(const Common::Image<float>& inputImage, openMVG::image::Image<unsigned char> &outputImage);
+void downscaleGRAY8(const openMVG::image::Image<unsigned char> &inputImage, std::size_t factor, openMVG::image::Image<unsigned char> &outputImage);
 
 /**
- * @brief convert a gray (unsigned char) 8 bits image to a 32 bits float image
- * @param inputImage
- * @param outputImage
+ * @brief Rescale intrinsics to another image resolution
+ * @param intrinsics
+ * @param scale - new resolution / intrinsics resolution
+ * @return the rescaled intrinsics
  */
-void convertGRAY8ToRGB32(openMVG::image::Image<unsigned char> &inputImage, const Common::Image<float>& outputImage);
+openMVG::cameras::Pinhole_Intrinsic_Radial_K3 rescaleIntrinsics(const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &intrinsics, double scale);
+
+/**
+ * @brief Rescale the 2D data of a localization result to another image resolution
+ * @param localizationResult
+ * @param scale - new resolution / localization resolution
+ * @return the rescaled localization result
+ */
+openMVG::localization::LocalizationResult rescaleLocalizationResult(const openMVG::localization::LocalizationResult &localizationResult, double scale);
+
+/**
+ * @brief Rescale the position and the scale of features to another image resolution
+ * @param scale - new resolution / features resolution
+ * @param features
+ */
+void rescaleFeatures(double scale, std::vector<openMVG::features::SIOPointFeature> &features);
 
 
 } //namespace Localizer
@@ -0,0 +1,679 @@
+#include "CameraLocalizerCache.hpp"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/streams/bufferstream.hpp>
+
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace openMVG_ofx {
+namespace Localizer {
+
+namespace bfs = boost::filesystem;
+namespace bip = boost::interprocess;
+
+namespace {
+
+const char kCacheFileMagic[8] = {'O', 'F', 'X', 'M', 'V', 'G', 'L', 'C'};
+const std::uint32_t kCacheFileVersion = 1;
+const std::size_t kCacheFileHeaderSize = sizeof(kCacheFileMagic) + sizeof(std::uint32_t);
+const std::string kCacheStatePrefix = "localizerCache2;";
+
+//The most recently used frames always keep their features (current frame and overlay tracks)
+const std::size_t kMinResidentFrames = 16;
+
+//Record header, followed by payloadSize bytes of cereal portable binary data
+const std::size_t kRecordHeaderSize = sizeof(std::uint32_t) + sizeof(double) + sizeof(std::uint64_t);
+
+struct RecordHeader
+{
+  std::uint32_t type;
+  double time;
+  std::uint64_t payloadSize;
+};
+
+void encodeRecordHeader(const RecordHeader &header, char *buffer)
+{
+  std::memcpy(buffer, &header.type, sizeof(std::uint32_t));
+  std::memcpy(buffer + sizeof(std::uint32_t), &header.time, sizeof(double));
+  std::memcpy(buffer + sizeof(std::uint32_t) + sizeof(double), &header.payloadSize, sizeof(std::uint64_t));
+}
+
+void decodeRecordHeader(const char *buffer, RecordHeader &header)
+{
+  std::memcpy(&header.type, buffer, sizeof(std::uint32_t));
+  std::memcpy(&header.time, buffer + sizeof(std::uint32_t), sizeof(double));
+  std::memcpy(&header.payloadSize, buffer + sizeof(std::uint32_t) + sizeof(double), sizeof(std::uint64_t));
+}
+
+} //namespace
+
+struct FrameDataCache::FileMapping
+{
+  bip::file_mapping file;
+  bip::mapped_region region;
+
+  explicit FileMapping(const std::string &filePath)
+    : file(filePath.c_str(), bip::read_only)
+    , region(file, bip::read_only)
+  {}
+
+  const char* data() const
+  {
+    return static_cast<const char*>(region.get_address());
+  }
+
+  std::size_t size() const
+  {
+    return region.get_size();
+  }
+};
+
+FrameDataCache::FrameDataCache()
+{}
+
+FrameDataCache::~FrameDataCache()
+{}
+
+void FrameDataCache::resetState()
+{
+  _mapping.reset();
+  _entries.clear();
+  _lru.clear();
+  _stats = Stats();
+  _hasher = Common::Hasher();
+  _fileSize = 0;
+  _nbRecords = 0;
+  _filePath.clear();
+  _expectedState.clear();
+  _isShared = false;
+  _isIndexed = true;
+}
+
+void FrameDataCache::open(const std::string &state)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  resetState();
+
+  if(state.empty())
+  {
+    return;
+  }
+
+  // "localizerCache2;<nbRecords>;<hash>;<path>"
+  const std::size_t nbRecordsEnd = state.find(';', kCacheStatePrefix.size());
+  const std::size_t hashEnd = (nbRecordsEnd == std::string::npos) ? std::string::npos : state.find(';', nbRecordsEnd + 1);
+  if(state.compare(0, kCacheStatePrefix.size(), kCacheStatePrefix) != 0 || hashEnd == std::string::npos)
+  {
+    throw std::runtime_error("Unknown localization cache state.");
+  }
+  std::string filePath = state.substr(hashEnd + 1);
+
+  //Another host may mount the cache folder at another path
+  boost::system::error_code error;
+  if(!bfs::exists(filePath, error))
+  {
+    const bfs::path folderFilePath = bfs::path(_folder.empty() ? Common::getCacheFolder() : _folder) / bfs::path(filePath).filename();
+    if(!bfs::exists(folderFilePath, error))
+    {
+      throw std::runtime_error("Localization cache file not found, check the Cache Folder : " + filePath);
+    }
+    filePath = folderFilePath.string();
+  }
+
+  _expectedState = state.substr(0, hashEnd);
+  _filePath = filePath;
+  _isShared = true;
+  _isIndexed = false;
+}
+
+void FrameDataCache::setFolder(const std::string &folder)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  _folder = folder;
+}
+
+void FrameDataCache::importFrames(std::map<OfxTime, FrameDataAtTime> &framesData)
+{
+  clear();
+
+  std::lock_guard<std::mutex> guard(_mutex);
+  for(auto &framesDataAtTime : framesData)
+  {
+    Entry &entry = _entries[framesDataAtTime.first];
+    entry.frameData.reset(new FrameDataAtTime(std::move(framesDataAtTime.second)));
+    touch(framesDataAtTime.first, entry);
+  }
+  framesData.clear();
+  rewriteFile();
+  enforceMemoryBudget();
+}
+
+std::string FrameDataCache::getState() const
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  if(_filePath.empty())
+  {
+    return std::string();
+  }
+  //Until the file is indexed, the state is the one given to open
+  if(!_isIndexed)
+  {
+    return _expectedState + ";" + _filePath;
+  }
+  return kCacheStatePrefix + std::to_string(_nbRecords) + ";" + _hasher.toString() + ";" + _filePath;
+}
+
+bool FrameDataCache::has(OfxTime time) const
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  index();
+  return _entries.find(time) != _entries.end();
+}
+
+FrameDataCache::FrameDataAtTimePtr FrameDataCache::at(OfxTime time) const
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  index();
+  Entry &entry = _entries.at(time);
+
+  if(entry.isResident)
+  {
+    ++_stats.nbHits;
+  }
+  else
+  {
+    ++_stats.nbMisses;
+    if(!makeResident(time, entry))
+    {
+      //Missing or corrupted record, the frame is no longer in cache
+      untrack(entry);
+      _entries.erase(time);
+      return FrameDataAtTimePtr();
+    }
+  }
+  touch(time, entry);
+  enforceMemoryBudget();
+  return entry.frameData;
+}
+
+std::vector<OfxTime> FrameDataCache::getTimes() const
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  index();
+  std::vector<OfxTime> times;
+  times.reserve(_entries.size());
+  for(const auto &entry : _entries)
+  {
+    times.push_back(entry.first);
+  }
+  return times;
+}
+
+void FrameDataCache::set(OfxTime time, const FrameDataAtTime &frameData)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  index();
+  prepareWrite();
+
+  Entry &entry = _entries[time];
+  if(entry.payloadSize > 0 && !makeResident(time, entry))
+  {
+    //The other inputs of the frame can't be read back, only the new results are kept
+    entry.frameData.reset();
+  }
+  //New data, the previous one may be held by a reader
+  std::shared_ptr<FrameDataAtTime> newFrameData = entry.frameData ? std::make_shared<FrameDataAtTime>(*entry.frameData)
+                                                                  : std::make_shared<FrameDataAtTime>();
+  for(auto &outputDataCache : frameData)
+  {
+    (*newFrameData)[outputDataCache.first] = outputDataCache.second;
+  }
+  entry.frameData = newFrameData;
+
+  {
+    std::ostringstream stream;
+    {
+      cereal::PortableBinaryOutputArchive archive(stream);
+      archive(*entry.frameData);
+    }
+    std::ofstream file(_filePath, std::ios::binary | std::ios::app);
+    appendRecord(file, eRecordFrame, time, stream.str(), &entry);
+  }
+  touch(time, entry);
+
+  //Compact the file when most of the records are outdated
+  if(_nbRecords > 2 * _entries.size() + 64)
+  {
+    rewriteFile();
+  }
+  enforceMemoryBudget();
+}
+
+void FrameDataCache::erase(OfxTime time)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  index();
+  auto it = _entries.find(time);
+  if(it == _entries.end())
+  {
+    return;
+  }
+  prepareWrite();
+  untrack(it->second);
+  _entries.erase(it);
+
+  std::ofstream file(_filePath, std::ios::binary | std::ios::app);
+  appendRecord(file, eRecordErase, time, std::string(), nullptr);
+}
+
+void FrameDataCache::clear()
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  //The file is kept, a saved state or a duplicated node may still use it
+  resetState();
+}
+
+void FrameDataCache::setMemoryBudget(std::size_t budget)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  _memoryBudget = budget;
+  enforceMemoryBudget();
+}
+
+FrameDataCache::Stats FrameDataCache::getStats() const
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  return _stats;
+}
+
+bool FrameDataCache::isLegacyState(const std::string &state)
+{
+  return state.compare(0, 5, "<?xml") == 0;
+}
+
+void FrameDataCache::index() const
+{
+  if(_isIndexed)
+  {
+    return;
+  }
+  _isIndexed = true;
+
+  bool isMatching = false;
+
+  try
+  {
+    _mapping.reset(new FileMapping(_filePath));
+    const char *data = _mapping->data();
+    const std::uint64_t size = _mapping->size();
+
+    std::uint32_t version = 0;
+    if(size < kCacheFileHeaderSize)
+    {
+      throw std::runtime_error("not a localization cache file");
+    }
+    std::memcpy(&version, data + sizeof(kCacheFileMagic), sizeof(version));
+    if(std::memcmp(data, kCacheFileMagic, sizeof(kCacheFileMagic)) != 0 || version != kCacheFileVersion)
+    {
+      throw std::runtime_error("not a localization cache file");
+    }
+    _hasher.update(data, kCacheFileHeaderSize);
+    _fileSize = kCacheFileHeaderSize;
+    Common::touchCacheFile(_filePath);
+
+    //Only the record headers are hashed, the file is append only
+    //Stop at the saved state, later records weren't saved in the script
+    isMatching = (kCacheStatePrefix + std::to_string(_nbRecords) + ";" + _hasher.toString() == _expectedState);
+
+    while(!isMatching && _fileSize + kRecordHeaderSize <= size)
+    {
+      RecordHeader header;
+      decodeRecordHeader(data + _fileSize, header);
+      const std::uint64_t payloadOffset = _fileSize + kRecordHeaderSize;
+      if(header.payloadSize > size - payloadOffset)
+      {
+        //Interrupted write
+        break;
+      }
+      _hasher.update(data + _fileSize, kRecordHeaderSize);
+      _fileSize = payloadOffset + header.payloadSize;
+      ++_nbRecords;
+
+      if(header.type == eRecordFrame)
+      {
+        Entry &entry = _entries[header.time];
+        entry.frameData.reset();
+        entry.payloadOffset = payloadOffset;
+        entry.payloadSize = header.payloadSize;
+      }
+      else if(header.type == eRecordErase)
+      {
+        _entries.erase(header.time);
+      }
+
+      isMatching = (kCacheStatePrefix + std::to_string(_nbRecords) + ";" + _hasher.toString() == _expectedState);
+    }
+  }
+  catch(std::exception &e)
+  {
+    std::cerr << "[CameraLocalizer] Warning: can't read localization cache " << _filePath << " : " << e.what() << std::endl;
+  }
+
+  if(!isMatching)
+  {
+    std::cerr << "[CameraLocalizer] Warning: localization cache " << _filePath << " doesn't match the saved state, " << _entries.size() << " frames found." << std::endl;
+  }
+  std::cout << "[CameraLocalizer] " << _entries.size() << " frames indexed from " << _nbRecords << " cache records" << std::endl;
+}
+
+void FrameDataCache::readPayload(const Entry &entry, FrameDataAtTime &frameData) const
+{
+  const std::uint64_t payloadEnd = entry.payloadOffset + entry.payloadSize;
+
+  //Records appended since the file was mapped need a new mapping
+  if(!_mapping || payloadEnd > _mapping->size())
+  {
+    _mapping.reset();
+    _mapping.reset(new FileMapping(_filePath));
+  }
+  if(payloadEnd > _mapping->size())
+  {
+    throw std::runtime_error("frame outside of the cache file");
+  }
+
+  bip::ibufferstream stream(_mapping->data() + entry.payloadOffset, entry.payloadSize);
+  cereal::PortableBinaryInputArchive archive(stream);
+  archive(frameData);
+}
+
+bool FrameDataCache::makeResident(OfxTime time, Entry &entry) const
+{
+  if(entry.isResident)
+  {
+    return true;
+  }
+
+  try
+  {
+    if(!entry.frameData)
+    {
+      //First access
+      entry.frameData.reset(new FrameDataAtTime());
+      readPayload(entry, *entry.frameData);
+      for(auto &cameraFrameData : *entry.frameData)
+      {
+        cameraFrameData.second.undistortedPt2D = cameraFrameData.second.localizationResult.retrieveUndistortedPt2D();
+      }
+    }
+    else
+    {
+      //Only the released fields are restored
+      FrameDataAtTime frameData;
+      readPayload(entry, frameData);
+      for(auto &cameraFrameData : *entry.frameData)
+      {
+        std::lock_guard<std::mutex> frameGuard(cameraFrameData.second.mutex);
+        auto it = frameData.find(cameraFrameData.first);
+        if(it != frameData.end())
+        {
+          cameraFrameData.second.extractedFeatures.swap(it->second.extractedFeatures);
+        }
+        cameraFrameData.second.undistortedPt2D = cameraFrameData.second.localizationResult.retrieveUndistortedPt2D();
+      }
+    }
+  }
+  catch(std::exception &e)
+  {
+    std::cerr << "[CameraLocalizer] Warning: can't load frame " << time << " from localization cache " << _filePath << ", it will be computed again : " << e.what() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void FrameDataCache::touch(OfxTime time, Entry &entry) const
+{
+  if(entry.isResident)
+  {
+    _lru.splice(_lru.begin(), _lru, entry.lruPosition);
+  }
+  else
+  {
+    _lru.push_front(time);
+    entry.lruPosition = _lru.begin();
+    entry.isResident = true;
+    ++_stats.nbResidentFrames;
+  }
+
+  std::size_t residentBytes = 0;
+  for(const auto &cameraFrameData : *entry.frameData)
+  {
+    residentBytes += cameraFrameData.second.extractedFeatures.capacity() * sizeof(openMVG::features::SIOPointFeature);
+    residentBytes += cameraFrameData.second.undistortedPt2D.size() * sizeof(double);
+  }
+  _stats.residentBytes = _stats.residentBytes - entry.residentBytes + residentBytes;
+  entry.residentBytes = residentBytes;
+}
+
+void FrameDataCache::untrack(Entry &entry) const
+{
+  if(!entry.isResident)
+  {
+    return;
+  }
+  _lru.erase(entry.lruPosition);
+  _stats.residentBytes -= entry.residentBytes;
+  --_stats.nbResidentFrames;
+  entry.residentBytes = 0;
+  entry.isResident = false;
+}
+
+void FrameDataCache::enforceMemoryBudget() const
+{
+  if(_memoryBudget == 0 || _lru.size() <= kMinResidentFrames)
+  {
+    return;
+  }
+
+  //The scan stops on the last of the most recently used frames, it is never erased
+  const auto lastKept = std::prev(std::next(_lru.begin(), kMinResidentFrames));
+  auto it = _lru.end();
+  while(_stats.residentBytes > _memoryBudget)
+  {
+    --it;
+    if(it == lastKept)
+    {
+      break;
+    }
+    Entry &entry = _entries.at(*it);
+
+    //Frames can only be released from the cache file, and not while a caller holds them.
+    //No new holder can appear without _mutex.
+    if(entry.payloadSize == 0 || entry.frameData.use_count() > 1)
+    {
+      continue;
+    }
+
+    for(auto &cameraFrameData : *entry.frameData)
+    {
+      std::vector<openMVG::features::SIOPointFeature>().swap(cameraFrameData.second.extractedFeatures);
+      cameraFrameData.second.undistortedPt2D.resize(0, 0);
+    }
+
+    _stats.residentBytes -= entry.residentBytes;
+    --_stats.nbResidentFrames;
+    entry.residentBytes = 0;
+    entry.isResident = false;
+    it = _lru.erase(it);
+  }
+}
+
+void FrameDataCache::prepareWrite()
+{
+  if(_filePath.empty() || _isShared)
+  {
+    rewriteFile();
+  }
+}
+
+void FrameDataCache::rewriteFile()
+{
+  //A file opened from a state is left in place, a saved script or another node may still use it
+  const std::string supersededFilePath = _isShared ? std::string() : _filePath;
+  const std::string filePath = Common::createCacheFilePath("localizer", ".ofxmvgcache", _folder);
+  std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+  if(!file)
+  {
+    throw std::runtime_error("Can't create localization cache file " + filePath);
+  }
+
+  _hasher = Common::Hasher();
+  _nbRecords = 0;
+
+  char header[kCacheFileHeaderSize];
+  std::memcpy(header, kCacheFileMagic, sizeof(kCacheFileMagic));
+  std::memcpy(header + sizeof(kCacheFileMagic), &kCacheFileVersion, sizeof(kCacheFileVersion));
+  file.write(header, kCacheFileHeaderSize);
+  _hasher.update(header, kCacheFileHeaderSize);
+  _fileSize = kCacheFileHeaderSize;
+
+  for(auto &entry : _entries)
+  {
+    std::string payload;
+    if(entry.second.payloadSize > 0)
+    {
+      //The last record of a frame matches its content, copy it as is
+      const std::uint64_t payloadEnd = entry.second.payloadOffset + entry.second.payloadSize;
+      if(!_mapping || payloadEnd > _mapping->size())
+      {
+        _mapping.reset();
+        _mapping.reset(new FileMapping(_filePath));
+      }
+      if(payloadEnd > _mapping->size())
+      {
+        throw std::runtime_error("Frame outside of the localization cache file " + _filePath);
+      }
+      payload.assign(_mapping->data() + entry.second.payloadOffset, entry.second.payloadSize);
+    }
+    else
+    {
+      std::ostringstream stream;
+      {
+        cereal::PortableBinaryOutputArchive archive(stream);
+        archive(*entry.second.frameData);
+      }
+      payload = stream.str();
+    }
+    appendRecord(file, eRecordFrame, entry.first, payload, &entry.second);
+  }
+  file.close();
+
+  _mapping.reset();
+  _filePath = filePath;
+  _isShared = false;
+
+  if(!supersededFilePath.empty())
+  {
+    boost::system::error_code error;
+    bfs::remove(supersededFilePath, error);
+  }
+}
+
+void FrameDataCache::appendRecord(std::ofstream &file, ERecordType type, OfxTime time, const std::string &payload, Entry *entry)
+{
+  RecordHeader header;
+  header.type = type;
+  header.time = time;
+  header.payloadSize = payload.size();
+
+  char headerBuffer[kRecordHeaderSize];
+  encodeRecordHeader(header, headerBuffer);
+  file.write(headerBuffer, kRecordHeaderSize);
+  file.write(payload.data(), payload.size());
+  file.flush();
+  if(!file)
+  {
+    throw std::runtime_error("Can't write in localization cache file");
+  }
+
+  _hasher.update(headerBuffer, kRecordHeaderSize);
+  if(entry != nullptr)
+  {
+    entry->payloadOffset = _fileSize + kRecordHeaderSize;
+    entry->payloadSize = payload.size();
+  }
+  _fileSize += kRecordHeaderSize + payload.size();
+  ++_nbRecords;
+}
+
+const std::size_t DraftFrameDataCache::kMaxFrames;
+
+bool DraftFrameDataCache::has(OfxTime time) const
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  return _entries.find(time) != _entries.end();
+}
+
+DraftFrameDataCache::FrameDataAtTimePtr DraftFrameDataCache::at(OfxTime time) const
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  const Entry &entry = _entries.at(time);
+  _lru.splice(_lru.begin(), _lru, entry.lruPosition);
+  return entry.frameData;
+}
+
+void DraftFrameDataCache::set(OfxTime time, const FrameDataAtTime &frameData)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto it = _entries.find(time);
+  if(it == _entries.end())
+  {
+    _lru.push_front(time);
+    it = _entries.emplace(time, Entry()).first;
+    it->second.lruPosition = _lru.begin();
+  }
+  else
+  {
+    _lru.splice(_lru.begin(), _lru, it->second.lruPosition);
+  }
+  //New data, the previous one may be held by a reader
+  it->second.frameData = std::make_shared<FrameDataAtTime>(frameData);
+
+  while(_lru.size() > kMaxFrames)
+  {
+    _entries.erase(_lru.back());
+    _lru.pop_back();
+  }
+}
+
+void DraftFrameDataCache::erase(OfxTime time)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto it = _entries.find(time);
+  if(it == _entries.end())
+  {
+    return;
+  }
+  _lru.erase(it->second.lruPosition);
+  _entries.erase(it);
+}
+
+void DraftFrameDataCache::clear()
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  _entries.clear();
+  _lru.clear();
+}
+
+} //namespace Localizer
+} //namespace openMVG_ofx
@@ -0,0 +1,289 @@
+#pragma once
+
+#include "CameraLocalizer.hpp"
+#include "../common/Cache.hpp"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace openMVG_ofx {
+namespace Localizer {
+
+/**
+ * @brief Localization results of the computed frames, stored in a binary cache file
+ * 
+ * Each change is appended to the file as a record, so storing a frame doesn't
+ * rewrite the whole cache. The plugin only keeps getState() (file path, number
+ * of records and hash of the record headers) in a parameter.
+ * 
+ * On first access the file is memory mapped and only the record headers are
+ * read, up to the record matching the state, so a script reopened without
+ * saving gets back the frames of its last save. A frame is deserialized, and
+ * its undistorted points computed, the first time it is accessed.
+ * A file opened from a state is never modified: the first change writes a new
+ * file, so duplicated nodes or scripts don't share their cache. Files opened
+ * from a state are never removed, only the files written by this cache and
+ * replaced by a compacted file.
+ * 
+ * The memory used by the extracted features and undistorted points is bounded:
+ * the least recently used frames release them, and they are reloaded from the
+ * file on the next access. Localization results (poses, matches, stats) stay
+ * in memory. Frames held by a caller are never released, and a frame set
+ * again gets new data, so the data returned by at() can be kept while used.
+ */
+class FrameDataCache
+{
+public:
+  typedef std::map<std::size_t, FrameData> FrameDataAtTime;
+  typedef std::shared_ptr<const FrameDataAtTime> FrameDataAtTimePtr;
+
+  struct Stats
+  {
+    std::size_t nbHits = 0;
+    std::size_t nbMisses = 0;
+    std::size_t residentBytes = 0;
+    std::size_t nbResidentFrames = 0;
+  };
+
+  FrameDataCache();
+  ~FrameDataCache();
+
+  FrameDataCache(const FrameDataCache &other) = delete;
+  FrameDataCache& operator=(const FrameDataCache &other) = delete;
+
+  /**
+   * @brief Use the cache described by a state string
+   * The file is not read before the first access. If it is not at its saved
+   * path, it is looked for in the cache folder.
+   * @param[in] state - from getState, empty for a new cache
+   * @throw std::runtime_error if the file of the state can't be found
+   */
+  void open(const std::string &state);
+
+  /**
+   * @brief Set the folder of the new cache files
+   * @param[in] folder - empty for the plugins cache folder, see Common::getCacheFolder
+   */
+  void setFolder(const std::string &folder);
+
+  /**
+   * @brief Replace the cache content, used to import older cache formats
+   * @param[in,out] framesData - moved into the cache
+   */
+  void importFrames(std::map<OfxTime, FrameDataAtTime> &framesData);
+
+  /**
+   * @brief Get a string describing the current cache file and content
+   * @return an empty string if the cache has no file
+   */
+  std::string getState() const;
+
+  /**
+   * @brief Check if a frame is in cache, without loading it
+   * @param[in] time
+   */
+  bool has(OfxTime time) const;
+
+  /**
+   * @brief Get the results of a frame, loaded from the file if needed
+   * The features of the frame aren't released while the result is held.
+   * A frame that can't be read from the file is removed from the cache.
+   * @param[in] time - must be in cache
+   * @return null if the frame can't be loaded
+   */
+  FrameDataAtTimePtr at(OfxTime time) const;
+
+  /**
+   * @brief Get the times of all the frames in cache, without loading them
+   */
+  std::vector<OfxTime> getTimes() const;
+
+  /**
+   * @brief Store the results of a frame, and append them to the cache file
+   * @param[in] time
+   * @param[in] frameData
+   */
+  void set(OfxTime time, const FrameDataAtTime &frameData);
+
+  /**
+   * @brief Remove the results of a frame
+   * @param[in] time
+   */
+  void erase(OfxTime time);
+
+  /**
+   * @brief Remove all results, the cache file is kept
+   */
+  void clear();
+
+  /**
+   * @brief Set the maximum memory used by the features of the cached frames
+   * @param[in] budget - in bytes, 0 for no limit
+   */
+  void setMemoryBudget(std::size_t budget);
+
+  Stats getStats() const;
+
+  /**
+   * @brief Check if a state string comes from the former XML serialization
+   * @param[in] state
+   */
+  static bool isLegacyState(const std::string &state);
+
+private:
+  enum ERecordType
+  {
+    eRecordFrame = 1,
+    eRecordErase = 2
+  };
+
+  struct Entry
+  {
+    std::shared_ptr<FrameDataAtTime> frameData; //null until loaded
+    std::uint64_t payloadOffset = 0;
+    std::uint64_t payloadSize = 0;
+    bool isResident = false; //features and undistorted points in memory
+    std::size_t residentBytes = 0;
+    std::list<OfxTime>::iterator lruPosition;
+  };
+
+  struct FileMapping;
+
+  /**
+   * @brief Index the cache file records if not already done
+   * Needs _mutex.
+   */
+  void index() const;
+
+  /**
+   * @brief Load a frame from the mapped file, or only its features and undistorted points if released
+   * Needs _mutex.
+   * @return false if the frame record can't be read
+   */
+  bool makeResident(OfxTime time, Entry &entry) const;
+
+  /**
+   * @brief Mark an entry as most recently used and update its memory
+   * Needs _mutex.
+   */
+  void touch(OfxTime time, Entry &entry) const;
+
+  /**
+   * @brief Release the features of the least recently used frames over the budget
+   * The kMinResidentFrames most recently used frames and the held frames are kept.
+   * Needs _mutex.
+   */
+  void enforceMemoryBudget() const;
+
+  /**
+   * @brief Forget the memory accounting of an entry before it is removed
+   * Needs _mutex.
+   */
+  void untrack(Entry &entry) const;
+
+  /**
+   * @brief Read the payload of an entry from the mapped file
+   * Needs _mutex.
+   */
+  void readPayload(const Entry &entry, FrameDataAtTime &frameData) const;
+
+  /**
+   * @brief Write all the frames in a new cache file
+   * The previous file is removed if it was written by this cache.
+   * Needs _mutex.
+   */
+  void rewriteFile();
+
+  /**
+   * @brief Write a new file if the current one can't be modified
+   * Needs _mutex.
+   */
+  void prepareWrite();
+
+  void appendRecord(std::ofstream &file, ERecordType type, OfxTime time, const std::string &payload, Entry *entry);
+
+  void resetState();
+
+  mutable std::mutex _mutex;
+  mutable bool _isIndexed = true;
+  mutable std::map<OfxTime, Entry> _entries;
+  mutable Common::Hasher _hasher;
+  mutable std::uint64_t _fileSize = 0;
+  mutable std::size_t _nbRecords = 0;
+  mutable std::unique_ptr<FileMapping> _mapping;
+  mutable std::list<OfxTime> _lru; //resident frames, most recent first
+  mutable Stats _stats;
+  std::size_t _memoryBudget = 0;
+  std::string _filePath;
+  std::string _folder;
+  std::string _expectedState;
+  bool _isShared = false;
+};
+
+/**
+ * @brief Proxy localization results, only kept in memory
+ * 
+ * Drafts are cheap to compute again, so they have no file and are not
+ * serialized. Only the kMaxFrames most recently used frames are kept.
+ * A frame set again gets new data, so the data returned by at() can be kept
+ * while used.
+ */
+class DraftFrameDataCache
+{
+public:
+  typedef FrameDataCache::FrameDataAtTime FrameDataAtTime;
+  typedef FrameDataCache::FrameDataAtTimePtr FrameDataAtTimePtr;
+
+  //Number of frames kept
+  static const std::size_t kMaxFrames = 64;
+
+  /**
+   * @brief Check if a frame is in cache
+   * @param[in] time
+   */
+  bool has(OfxTime time) const;
+
+  /**
+   * @brief Get the results of a frame
+   * @param[in] time - must be in cache
+   */
+  FrameDataAtTimePtr at(OfxTime time) const;
+
+  /**
+   * @brief Store the results of a frame, the least recently used frame is forgotten above kMaxFrames
+   * @param[in] time
+   * @param[in] frameData
+   */
+  void set(OfxTime time, const FrameDataAtTime &frameData);
+
+  /**
+   * @brief Remove the results of a frame
+   * @param[in] time
+   */
+  void erase(OfxTime time);
+
+  /**
+   * @brief Remove all results
+   */
+  void clear();
+
+private:
+  struct Entry
+  {
+    FrameDataAtTimePtr frameData;
+    std::list<OfxTime>::iterator lruPosition;
+  };
+
+  mutable std::mutex _mutex;
+  mutable std::list<OfxTime> _lru; //most recent first
+  std::map<OfxTime, Entry> _entries;
+};
+
+} //namespace Localizer
+} //namespace openMVG_ofx
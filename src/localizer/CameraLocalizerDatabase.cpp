@@ -0,0 +1,215 @@
+#include "CameraLocalizerDatabase.hpp"
+#include "CameraLocalizer.hpp"
+#include "../common/Cache.hpp"
+
+#include <openMVG/sfm/sfm_data.hpp>
+#include <openMVG/sfm/sfm_data_io.hpp>
+#include <openMVG/localization/VoctreeLocalizer.hpp>
+#if HAVE_CCTAG
+#include <openMVG/localization/CCTagLocalizer.hpp>
+#endif
+
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace openMVG_ofx {
+namespace Localizer {
+
+namespace bfs = boost::filesystem;
+
+namespace {
+
+//Change to invalidate the existing snapshots
+const std::uint32_t kSfMDataSnapshotVersion = 1;
+
+//LocalizerSlot structure for a registry entry
+struct LocalizerSlot
+{
+  std::weak_ptr<openMVG::localization::ILocalizer> localizer;
+  SharedLocalizerFuture loading; //valid while the database is loading
+};
+
+//LocalizerRegistry structure for the shared databases and their loader threads
+struct LocalizerRegistry
+{
+  std::mutex mutex;
+  std::map<LocalizerDatabaseKey, LocalizerSlot> slots;
+  std::vector<std::future<void> > loaders; //std::async futures, joined when destroyed
+
+  ~LocalizerRegistry()
+  {
+    //The library can be unloaded, the loads in progress are waited
+    for(std::future<void> &loader : loaders)
+      loader.wait();
+  }
+};
+
+LocalizerRegistry gRegistry;
+
+openMVG::localization::ILocalizer* createLocalizer(const LocalizerDatabaseKey &key)
+{
+  switch(key.describer)
+  {
+    case eParamFeaturesTypeSIFT :
+    case eParamFeaturesTypeSIFTAndCCTag :
+      return new openMVG::localization::VoctreeLocalizer(getSfMDataSnapshot(key.reconstructionFile),
+                                                         key.descriptorsFolder,
+                                                         key.voctreeFile,
+                                                         key.voctreeWeightsFile
+#if HAVE_CCTAG
+                                                         ,(eParamFeaturesTypeSIFTAndCCTag == key.describer)
+#endif
+                                                         );
+#if HAVE_CCTAG
+    case eParamFeaturesTypeCCTag :
+      return new openMVG::localization::CCTagLocalizer(getSfMDataSnapshot(key.reconstructionFile),
+                                                       key.descriptorsFolder);
+#endif
+    default : throw std::invalid_argument("Unrecognized Features Type : " + std::to_string(key.describer));
+  }
+}
+
+} //namespace
+
+std::string getSfMDataSnapshot(const std::string &sfmFilePath)
+{
+  if(sfmFilePath.empty() || bfs::path(sfmFilePath).extension() == ".bin")
+  {
+    return sfmFilePath;
+  }
+
+  try
+  {
+    const bfs::path path = bfs::canonical(sfmFilePath);
+
+    Common::Hasher hasher;
+    hasher.updateValue(kSfMDataSnapshotVersion);
+    hasher.update(path.string());
+    hasher.updateValue(static_cast<std::uint64_t>(bfs::file_size(path)));
+    hasher.updateValue(static_cast<std::int64_t>(bfs::last_write_time(path)));
+
+    const bfs::path snapshotPath = bfs::path(Common::getCacheFolder()) / ("sfm_" + hasher.toString() + ".bin");
+    if(bfs::exists(snapshotPath))
+    {
+      Common::touchCacheFile(snapshotPath.string());
+      std::cout << "[CameraLocalizer] Use SfM data snapshot " << snapshotPath.string() << std::endl;
+      return snapshotPath.string();
+    }
+
+    openMVG::sfm::SfM_Data sfmData;
+    if(!openMVG::sfm::Load(sfmData, sfmFilePath, openMVG::sfm::ESfM_Data(openMVG::sfm::ALL)))
+    {
+      return sfmFilePath;
+    }
+
+    //Written aside then renamed, another instance may read the snapshot
+    const std::string tmpPath = Common::createCacheFilePath("sfm", ".bin");
+    if(!openMVG::sfm::Save(sfmData, tmpPath, openMVG::sfm::ESfM_Data(openMVG::sfm::ALL)))
+    {
+      boost::system::error_code error;
+      bfs::remove(tmpPath, error);
+      return sfmFilePath;
+    }
+    bfs::rename(tmpPath, snapshotPath);
+
+    std::cout << "[CameraLocalizer] SfM data snapshot created : " << snapshotPath.string() << std::endl;
+    return snapshotPath.string();
+  }
+  catch(std::exception &e)
+  {
+    std::cerr << "[CameraLocalizer] Warning: can't use a SfM data snapshot for " << sfmFilePath << " : " << e.what() << std::endl;
+  }
+  return sfmFilePath;
+}
+
+SharedLocalizerFuture getSharedLocalizerAsync(const LocalizerDatabaseKey &key)
+{
+  std::lock_guard<std::mutex> guard(gRegistry.mutex);
+
+  //Forget the released databases and the finished loads
+  for(auto it = gRegistry.slots.begin(); it != gRegistry.slots.end();)
+  {
+    if(it->second.localizer.expired() && !it->second.loading.valid())
+      it = gRegistry.slots.erase(it);
+    else
+      ++it;
+  }
+  gRegistry.loaders.erase(std::remove_if(gRegistry.loaders.begin(), gRegistry.loaders.end(), [](const std::future<void> &loader)
+  {
+    return loader.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }), gRegistry.loaders.end());
+
+  LocalizerSlot &slot = gRegistry.slots[key];
+  if(slot.loading.valid())
+  {
+    return slot.loading;
+  }
+
+  std::shared_ptr<std::promise<std::shared_ptr<openMVG::localization::ILocalizer> > > promise =
+          std::make_shared<std::promise<std::shared_ptr<openMVG::localization::ILocalizer> > >();
+
+  if(std::shared_ptr<openMVG::localization::ILocalizer> localizer = slot.localizer.lock())
+  {
+    promise->set_value(localizer);
+    return promise->get_future().share();
+  }
+
+  slot.loading = promise->get_future().share();
+
+  //The slot only keeps the future while loading, so the registry never holds the localizer
+  gRegistry.loaders.push_back(std::async(std::launch::async, [key, promise]()
+  {
+    std::cout << "[CameraLocalizer] Load localizer database : " << key.reconstructionFile << std::endl;
+    std::shared_ptr<openMVG::localization::ILocalizer> localizer;
+    std::exception_ptr error;
+    try
+    {
+      //The localizer owns a SIFT describer, which sets up and tears down the VLFeat state,
+      //so the features extractions of the other instances wait for the load
+      openMVG::localization::ILocalizer *newLocalizer;
+      {
+        std::lock_guard<VLFeatStateLock> guard(getVLFeatStateLock());
+        newLocalizer = createLocalizer(key);
+      }
+      localizer.reset(newLocalizer, &deleteLocalizer);
+    }
+    catch(...)
+    {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(gRegistry.mutex);
+      LocalizerSlot &slot = gRegistry.slots[key];
+      slot.localizer = localizer;
+      slot.loading = SharedLocalizerFuture();
+    }
+
+    if(error)
+    {
+      promise->set_exception(error);
+      return;
+    }
+    std::cout << "[CameraLocalizer] Localizer database loaded : " << key.reconstructionFile << std::endl;
+    promise->set_value(localizer);
+  }));
+
+  return slot.loading;
+}
+
+std::shared_ptr<openMVG::localization::ILocalizer> getSharedLocalizer(const LocalizerDatabaseKey &key)
+{
+  return getSharedLocalizerAsync(key).get();
+}
+
+} //namespace Localizer
+} //namespace openMVG_ofx
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "CameraLocalizerPluginDefinition.hpp"
+
+#include <openMVG/localization/ILocalizer.hpp>
+
+#include <future>
+#include <memory>
+#include <string>
+#include <tuple>
+
+namespace openMVG_ofx {
+namespace Localizer {
+
+//LocalizerDatabaseKey structure for the files defining a localizer database
+struct LocalizerDatabaseKey
+{
+  EParamFeaturesType describer = eParamFeaturesTypeSIFT;
+  std::string reconstructionFile;
+  std::string descriptorsFolder;
+  std::string voctreeFile;
+  std::string voctreeWeightsFile;
+  
+  bool operator<(const LocalizerDatabaseKey &other) const
+  {
+    return std::tie(describer, reconstructionFile, descriptorsFolder, voctreeFile, voctreeWeightsFile) <
+           std::tie(other.describer, other.reconstructionFile, other.descriptorsFolder, other.voctreeFile, other.voctreeWeightsFile);
+  }
+  
+  bool operator==(const LocalizerDatabaseKey &other) const
+  {
+    return std::tie(describer, reconstructionFile, descriptorsFolder, voctreeFile, voctreeWeightsFile) ==
+           std::tie(other.describer, other.reconstructionFile, other.descriptorsFolder, other.voctreeFile, other.voctreeWeightsFile);
+  }
+};
+
+typedef std::shared_future<std::shared_ptr<openMVG::localization::ILocalizer> > SharedLocalizerFuture;
+
+/**
+ * @brief Get a binary snapshot of a SfM data file
+ * The snapshot is created in the cache folder on first use, and keyed by the
+ * path, size and modification time of the SfM data file.
+ * @param[in] sfmFilePath - reconstruction file
+ * @return the snapshot path, or sfmFilePath if it is already binary or the snapshot can't be created
+ */
+std::string getSfMDataSnapshot(const std::string &sfmFilePath);
+
+/**
+ * @brief Get the localizer of a database, shared by all the plugin instances
+ * The localizer is loaded in a thread owned by the registry if no instance holds it
+ * anymore, and released with its last user. A load in progress is shared by
+ * all the instances asking for the same database. It must only be used to
+ * localize (read only access).
+ * @param[in] key
+ * @return a future on the localizer, holding the exception if the load fails
+ */
+SharedLocalizerFuture getSharedLocalizerAsync(const LocalizerDatabaseKey &key);
+
+/**
+ * @brief Get the localizer of a database, blocking until it is loaded
+ * @see getSharedLocalizerAsync
+ * @param[in] key
+ * @return the localizer
+ */
+std::shared_ptr<openMVG::localization::ILocalizer> getSharedLocalizer(const LocalizerDatabaseKey &key);
+
+} //namespace Localizer
+} //namespace openMVG_ofx
@@ -49,7 +49,9 @@ bool CameraLocalizerInteract::draw(const OFX::DrawArgs &args)
   bool drawMatchedFeatures = _plugin->hasOverlayMatchedFeatures();
   bool drawResectionFeatures = _plugin->hasOverlayResectionFeatures();
   bool drawReprojectionError = _plugin->hasOverlayReprojectionError();
-  bool drawReconstructionVisibility = _plugin->hasOverlayReconstructionVisibility();
+  //Kept alive while drawing, the render may swap the localizer database
+  const std::shared_ptr<const openMVG::localization::ILocalizer> localizer = _plugin->getLocalizer();
+  bool drawReconstructionVisibility = _plugin->hasOverlayReconstructionVisibility() && localizer;
   bool drawFeaturesId = _plugin->hasOverlayFeaturesId();
   bool drawFeaturesScaleOrientation = _plugin->hasOverlayFeaturesScaleOrientation();
   bool drawTracks = _plugin->hasOverlayTracks();
@@ -63,13 +65,25 @@ bool CameraLocalizerInteract::draw(const OFX::DrawArgs &args)
     return false;
   }
 
+  //Proxy results are replaced by the next full resolution render
+  if(_plugin->isDraftFrameDataCache(args.time))
+  {
+    glColor3f(1.f, 1.f, 0.f);
+    stb_print_string(10.f, 10.f, "draft localization");
+  }
+
   std::array<float, 3> colorDetected = {.6f, .5f, .5f};
   std::array<float, 3> colorMatched = {1.f, 0.5f, 0.5f};
   std::array<float, 3> colorTrackMatchHole = {.7f, .0f, .7f};
   std::array<float, 3> colorResection = {.5f, 1.f, .5f};
 
-  //Get frame cache and check mutex
-  const FrameData& frameCachedData = _plugin->getOutputFrameDataCache(args.time);
+  //Get frame cache, held during the draw so its features aren't released
+  const std::shared_ptr<const FrameData> frameCachedDataPtr = _plugin->getOutputFrameDataCache(args.time);
+  if(!frameCachedDataPtr)
+  {
+    return false;
+  }
+  const FrameData& frameCachedData = *frameCachedDataPtr;
   //std::lock_guard<std::mutex> guard(frameCachedData.mutex);
   
   openMVG::cameras::Pinhole_Intrinsic_Radial_K3 intrinsics;
@@ -135,7 +149,7 @@ bool CameraLocalizerInteract::draw(const OFX::DrawArgs &args)
   }
   
   const openMVG::localization::LocalizationResult& localizationResult = frameCachedData.localizationResult;
-  const std::size_t nbViews = _plugin->getLocalizerSfMData().views.size();
+  const std::size_t nbViews = drawReconstructionVisibility ? localizer->getSfMData().views.size() : 0;
 
   openMVG::Mat pt2dDetected = frameCachedData.undistortedPt2D; 
   openMVG::Mat pt2dProjected;
@@ -176,7 +190,10 @@ bool CameraLocalizerInteract::draw(const OFX::DrawArgs &args)
       if(!_plugin->hasFrameDataCache(time))
         continue;
       
-      const FrameData& frameAtTimeCachedData = _plugin->getOutputFrameDataCache(time);
+      const std::shared_ptr<const FrameData> frameAtTimeCachedDataPtr = _plugin->getOutputFrameDataCache(time);
+      if(!frameAtTimeCachedDataPtr)
+        continue;
+      const FrameData& frameAtTimeCachedData = *frameAtTimeCachedDataPtr;
 
       // Do not lock the current time: args.time
       std::mutex doNotLock;
@@ -329,7 +346,7 @@ bool CameraLocalizerInteract::draw(const OFX::DrawArgs &args)
       
       if(drawReconstructionVisibility)
       {
-        float obs = _plugin->getLocalizerSfMData().structure.find(pt3dIndex)->second.obs.size() / (float) nbViews;
+        float obs = localizer->getSfMData().structure.find(pt3dIndex)->second.obs.size() / (float) nbViews;
         
         glColor3f(0.f,obs, 1 - obs);
       }
@@ -388,7 +405,7 @@ bool CameraLocalizerInteract::draw(const OFX::DrawArgs &args)
       if(drawReconstructionVisibility)
       {
         openMVG::IndexT pt2dIndex = localizationResult.getIndMatch3D2D()[i].second;
-        float obs = _plugin->getLocalizerSfMData().structure.find(pt3dIndex)->second.obs.size() / (float) nbViews;
+        float obs = localizer->getSfMData().structure.find(pt3dIndex)->second.obs.size() / (float) nbViews;
         
         glColor3f(0.f,obs, 1 - obs);
       }
@@ -1,5 +1,8 @@
 #include "CameraLocalizerPlugin.hpp"
 #include "../common/Image.hpp"
+#include "../common/GrayConversion.hpp"
+#include "../common/ThreadPool.hpp"
+#include "../common/UndistortMap.hpp"
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -12,6 +15,9 @@
 
 #include <stdio.h>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <deque>
 #include <iostream>
 #include <algorithm>
 
@@ -90,26 +96,15 @@ void CameraLocalizerPlugin::parametersSetup()
   //Get Features type enum
   EParamFeaturesType describer = static_cast<EParamFeaturesType>(_featureType->getValue());
 
+  //The features type selects the database
+  startLocalizerLoading();
+
   switch(describer)
   {
     //Set SIFT an SIFTAndCCTag parameters
     case eParamFeaturesTypeSIFT :
     case eParamFeaturesTypeSIFTAndCCTag :
     {
-      if(!_uptodateDescriptor) 
-      {
-        openMVG::localization::VoctreeLocalizer *tmpLoc;
-        tmpLoc = new openMVG::localization::VoctreeLocalizer(_reconstructionFile->getValue(),
-                                                             _descriptorsFolder->getValue(),
-                                                             _voctreeFile->getValue(),
-                                                             _voctreeWeightsFile->getValue()
-#if HAVE_CCTAG
-                                                             ,(eParamFeaturesTypeSIFTAndCCTag == describer)
-#endif
-                                                             );
-        _processData.localizer.reset(tmpLoc);
-      }
-
       openMVG::localization::VoctreeLocalizer::Parameters *tmpParam;
       tmpParam = new openMVG::localization::VoctreeLocalizer::Parameters();
       _processData.param.reset(tmpParam);
@@ -127,14 +122,6 @@ void CameraLocalizerPlugin::parametersSetup()
     //Set CCTag only parameters
     case eParamFeaturesTypeCCTag :
     {
-      if(!_uptodateDescriptor)
-      {
-        openMVG::localization::CCTagLocalizer *tmpLoc;
-        tmpLoc = new openMVG::localization::CCTagLocalizer(_reconstructionFile->getValue(),
-                                                           _descriptorsFolder->getValue());
-        _processData.localizer.reset(tmpLoc);
-      }
-
       openMVG::localization::CCTagLocalizer::Parameters *tmpParam;
       tmpParam = new openMVG::localization::CCTagLocalizer::Parameters();
       _processData.param.reset(tmpParam);
@@ -147,7 +134,6 @@ void CameraLocalizerPlugin::parametersSetup()
     default : throw std::invalid_argument("Unrecognized Features Type : " + std::to_string(describer));
   }
   //
-  assert(_processData.localizer);
   assert(_processData.param);
   
   //Set other common parameters
@@ -159,13 +145,137 @@ void CameraLocalizerPlugin::parametersSetup()
   _processData.param->_errorMax = _reprojectionError->getValue();
   _processData.param->_fDistRatio = _distanceRatio->getValue();
   
-  const openMVG::sfm::SfM_Data &sfMData = _processData.localizer->getSfMData();
-  
-  _sfMDataNbViews->setValue( std::to_string(sfMData.views.size()) );
-  _sfMDataNbPoses->setValue( std::to_string(sfMData.poses.size()) ); 
-  _sfMDataNbIntrinsics->setValue( std::to_string(sfMData.intrinsics.size()) ); 
-  _sfMDataNbStructures->setValue( std::to_string(sfMData.structure.size()) );
-  _sfMDataNbControlPoints->setValue( std::to_string(sfMData.control_points.size()) );
+  //Set tracking parameters
+  _tracking.param.minInliers = _trackingMinInliers->getValue();
+  _tracking.param.searchRadius = _trackingSearchRadius->getValue();
+  _tracking.param.distanceRatio = _distanceRatio->getValue();
+  _tracking.param.errorMax = _reprojectionError->getValue();
+  _tracking.param.resectionEstimator = _processData.param->_resectionEstimator;
+  _tracking.param.useOpticalFlow = (static_cast<EParamTrackingMode>(_trackingMode->getValue()) == eParamTrackingModeOpticalFlow);
+  _tracking.param.minTracks = _trackingMinTracks->getValue();
+}
+
+FrameTracking* CameraLocalizerPlugin::getFrameTracking()
+{
+  //Reset requested by the UI thread
+  if(_resetTracking.exchange(false))
+  {
+    _tracking.clear();
+  }
+
+  if(static_cast<EParamTrackingMode>(_trackingMode->getValue()) == eParamTrackingModeNone)
+  {
+    return nullptr;
+  }
+  return &_tracking;
+}
+
+void CameraLocalizerPlugin::startLocalizerLoading()
+{
+  LocalizerDatabaseKey databaseKey;
+  databaseKey.describer = static_cast<EParamFeaturesType>(_featureType->getValue());
+  databaseKey.reconstructionFile = _reconstructionFile->getValue();
+  databaseKey.descriptorsFolder = _descriptorsFolder->getValue();
+  databaseKey.voctreeFile = _voctreeFile->getValue();
+  databaseKey.voctreeWeightsFile = _voctreeWeightsFile->getValue();
+
+  std::lock_guard<std::mutex> lock(_localizerMutex);
+
+  //Already requested
+  if(_hasDatabaseKey && (databaseKey == _databaseKey))
+  {
+    return;
+  }
+
+  //Only record the request, the render or the track swaps the localizer
+  _databaseKey = databaseKey;
+  _hasDatabaseKey = true;
+  _databaseChanged = true;
+  _localizerLoading = SharedLocalizerFuture();
+
+  if(databaseKey.reconstructionFile.empty())
+  {
+    _databaseStatus->setValue("No reconstruction file");
+    return;
+  }
+
+  std::cout << "localizer : [database] start loading " << databaseKey.reconstructionFile << std::endl;
+  _databaseStatus->setValue("Loading...");
+  _localizerLoading = getSharedLocalizerAsync(databaseKey);
+}
+
+std::shared_ptr<openMVG::localization::ILocalizer> CameraLocalizerPlugin::waitLocalizerLoading(const std::function<bool()> &isCanceled)
+{
+  LocalizerDatabaseKey databaseKey;
+  SharedLocalizerFuture localizerLoading;
+  {
+    std::lock_guard<std::mutex> lock(_localizerMutex);
+    if(!_databaseChanged)
+    {
+      return _localizer;
+    }
+    databaseKey = _databaseKey;
+    localizerLoading = _localizerLoading;
+  }
+
+  std::shared_ptr<openMVG::localization::ILocalizer> localizer;
+  std::string error;
+  if(localizerLoading.valid())
+  {
+    //Poll to stay responsive to the host cancellation
+    while(localizerLoading.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready)
+    {
+      if(isCanceled())
+      {
+        return nullptr;
+      }
+    }
+
+    try
+    {
+      localizer = localizerLoading.get();
+    }
+    catch(std::exception &e)
+    {
+      error = e.what();
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_localizerMutex);
+    
+    //Requested again while waiting, or already swapped by another thread
+    if(!_databaseChanged || !(databaseKey == _databaseKey))
+    {
+      return localizer;
+    }
+    _localizer = localizer;
+    _localizerLoading = SharedLocalizerFuture();
+    _databaseChanged = false;
+  }
+
+  //The previous frame tracking was localized in the previous database
+  _resetTracking = true;
+
+  if(!error.empty())
+  {
+    _databaseStatus->setValue("Failed : " + error);
+    sendMessage(OFX::Message::eMessageError, "cameralocalization.database", 
+            "Cannot load the localizer database : " + error);
+  }
+  else if(localizer)
+  {
+    const openMVG::sfm::SfM_Data &sfMData = localizer->getSfMData();
+
+    _sfMDataNbViews->setValue( std::to_string(sfMData.views.size()) );
+    _sfMDataNbPoses->setValue( std::to_string(sfMData.poses.size()) ); 
+    _sfMDataNbIntrinsics->setValue( std::to_string(sfMData.intrinsics.size()) ); 
+    _sfMDataNbStructures->setValue( std::to_string(sfMData.structure.size()) );
+    _sfMDataNbControlPoints->setValue( std::to_string(sfMData.control_points.size()) );
+    _databaseStatus->setValue("Ready");
+  }
+
+  return localizer;
 }
 
 bool CameraLocalizerPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionArguments &args, OfxRectD &rod)
@@ -184,11 +294,11 @@ bool CameraLocalizerPlugin::getRegionOfDefinition(const OFX::RegionOfDefinitionA
 void CameraLocalizerPlugin::beginSequenceRender(const OFX::BeginSequenceRenderArguments &args)
 {
   std::cout << "sequence render : begin : " << timeLineGetTime() << std::endl;
-  if(!_uptodateParam || !_uptodateDescriptor)
+  //The localizer database is not waited here, only frames to compute need it
+  if(!_uptodateParam)
   {
    parametersSetup();
    _uptodateParam = true;
-   _uptodateDescriptor = true;
   }
 }
 
@@ -228,10 +338,13 @@ void CameraLocalizerPlugin::render(const OFX::RenderArguments &args)
     return;
   }
  
+  //Interactive renders are localized on proxy images
+  const bool isDraft = args.renderQualityDraft || (args.renderScale.x < 1.0) || (args.renderScale.y < 1.0);
+  
   //Process Data initialization
   std::map<std::size_t, openMVG::localization::LocalizationResult> mapLocResults;
   std::map<std::size_t, openMVG::cameras::Pinhole_Intrinsic_Radial_K3> mapIntrinsics; //TODO : Change for different camera type
-  std::map<std::size_t, openMVG::image::Image<unsigned char> > mapImageGray;
+  std::map<std::size_t, openMVG::image::Image<unsigned char> > &mapImageGray = _inputsGray;
   
   //Collect Images in input
   if(!getInputsInGrayScale(args.time, mapImageGray))
@@ -242,99 +355,74 @@ void CameraLocalizerPlugin::render(const OFX::RenderArguments &args)
   
   try
   {  
-    //Check if the frame has already been computed
+    //Check if the frame has already been computed, a draft is enough for a draft render
     if(!_alwaysComputeFrame->getValue() &&
-        hasFrameDataCache(args.time)) 
+        ((_framesData.has(args.time) && _framesData.at(args.time)) || (isDraft && _draftFramesData.has(args.time))))
     {
       //Don't launch the tracker if we already have a keyFrame at current time.
       //We only need to provide the output image to the host.
       std::cout << "render : [stopped] frame already computed at frame : " << args.time << std::endl;
-      
-      for(auto &inputFrameData : getFrameDataCache(args.time))
-      {
-        mapLocResults[inputFrameData.first] = inputFrameData.second.localizationResult;
-        mapIntrinsics[inputFrameData.first] = inputFrameData.second.localizationResult.getIntrinsics(); //TODO: remove and read intrinsics from output parameters
-      }
-      std::cout << "render : [stopped] cache loaded at time : " << args.time << std::endl;
     }
     else
     {
+      //Wait for the localizer database, kept alive until the end of the render
+      const std::shared_ptr<openMVG::localization::ILocalizer> localizer = waitLocalizerLoading([this]() { return abort(); });
+      if(!localizer)
+      {
+        std::cout << "render : [quit] localizer database not loaded at frame " << args.time << std::endl;
+        return;
+      }
+      
       //Ensure Localizer is correctly initialized
-      if(!_processData.localizer->isInit())
+      if(!localizer->isInit())
       {
         std::cerr << "render : [error] Cannot initialize the camera localizer at frame " << args.time << "." << std::endl;
         return;
       }
       
-      //Collect Query Data
-      std::vector<bool> vecQueryHasIntrinsics(getNbConnectedInput());
-      std::vector< openMVG::cameras::Pinhole_Intrinsic_Radial_K3 > vecQueryIntrinsics(getNbConnectedInput()); //TODO : Change for different camera type
-      std::vector< std::pair<std::size_t, std::size_t> > vecQueryImageSize(getNbConnectedInput()); 
-      std::vector< std::unique_ptr<openMVG::features::Regions> > vecQueryRegions(getNbConnectedInput());
-      std::vector< openMVG::geometry::Pose3 > vecQuerySubPoses(getNbConnectedInput() - 1); //Don't save main camera
-
-      for(std::size_t input = 0; input < getNbConnectedInput(); ++input)
+      //Scale of the localized images relative to the full resolution.
+      //Input images are already at render scale, proxies are downscaled further to the proxy scale.
+      double imageScale = args.renderScale.x;
+      std::map<std::size_t, openMVG::image::Image<unsigned char> > mapImageProxy;
+      const std::map<std::size_t, openMVG::image::Image<unsigned char> > *mapImageLocalized = &mapImageGray;
+      if(isDraft)
       {
-        std::size_t clipIndex = _connectedClipIdx[input];
-
-        if(input > 0) //We don't save the main camera relative pose (for the moment)
+        const std::size_t factor = std::max(1, static_cast<int>(std::floor(imageScale / _proxyScale->getValue() + 1e-3)));
+        if(factor > 1)
         {
-          getInputSubPose(clipIndex,  vecQuerySubPoses[input - 1]);
+          for(const auto &inputImageGray : mapImageGray)
+          {
+            downscaleGRAY8(inputImageGray.second, factor, mapImageProxy[inputImageGray.first]);
+          }
+          mapImageLocalized = &mapImageProxy;
+          imageScale /= factor;
         }
-        vecQueryImageSize[input] = std::make_pair<std::size_t, std::size_t>(mapImageGray[clipIndex].Width(), mapImageGray[clipIndex].Height());  
-        vecQueryIntrinsics[input] = openMVG::cameras::Pinhole_Intrinsic_Radial_K3 (mapImageGray[clipIndex].Width(), mapImageGray[clipIndex].Height());  //TODO : Change for different camera type
-        vecQueryHasIntrinsics[input] = getInputIntrinsics(args.time, clipIndex, vecQueryIntrinsics[input]);
+        std::cout << "render : [proxy] localize at scale " << imageScale << std::endl;
       }
       
-      if(abort())
+      //Collect Query Data
+      FrameQuery query;
+      std::vector< std::pair<std::size_t, std::size_t> > vecImageSize;
+      for(std::size_t input = 0; input < getNbConnectedInput(); ++input)
       {
-        return;
+        const openMVG::image::Image<unsigned char> &imageGray = mapImageLocalized->at(_connectedClipIdx[input]);
+        vecImageSize.emplace_back(imageGray.Width(), imageGray.Height());
       }
-      
-      //Extract features
-      _processData.extractFeatures(mapImageGray, vecQueryRegions);
+      getFrameQuery(args.time, vecImageSize, query, imageScale);
       
       if(abort())
       {
         return;
       }
       
-      //Localization Process
-      if(isRigInInput() && !isRigModeUnknown())
-      {
-        std::cout << "render : [localization] Known RIG" << std::endl;
-        openMVG::geometry::Pose3 mainCameraPose;
-        std::vector<openMVG::localization::LocalizationResult> vecLocResults;
-
-        _processData.localizeRig(vecQueryRegions,
-                                vecQueryImageSize,
-                                vecQueryIntrinsics,
-                                vecQuerySubPoses,
-                                mainCameraPose,
-                                vecLocResults);
-        
-        for(std::size_t input = 0; input < vecLocResults.size(); ++input)
-        {
-          std::size_t clipIndex = _connectedClipIdx[input];
-          mapLocResults[clipIndex] = vecLocResults[input];
-        }
-      }
-      else
+      //Extract features and localize
+      std::vector<openMVG::localization::LocalizationResult> vecLocResults;
+      std::vector< std::vector<openMVG::features::SIOPointFeature> > vecFeatures;
       {
-        if(isRigInInput())
-          std::cout << "render : [localization] Simple mode : unknown RIG" << std::endl;
-        else
-          std::cout << "render : [localization] Simple mode : one camera" << std::endl;
-                
-        for(std::size_t input = 0; input < getNbConnectedInput(); ++input)
-        {
-          std::size_t clipIndex = _connectedClipIdx[input];
-          _processData.localize(vecQueryRegions[input],
-                                vecQueryImageSize[input],
-                                vecQueryHasIntrinsics[input],
-                                vecQueryIntrinsics[input],
-                                mapLocResults[clipIndex]);
-        }
+        //A running track owns the tracking state, localize without it
+        std::unique_lock<std::mutex> trackingLock(_trackingMutex, std::try_to_lock);
+        FrameTracking *tracking = trackingLock.owns_lock() ? getFrameTracking() : nullptr;
+        _processData.localizeFrame(*localizer, *mapImageLocalized, query, _nbThreads->getValue(), vecLocResults, vecFeatures, tracking);
       }
       
       if(abort())
@@ -342,54 +430,25 @@ void CameraLocalizerPlugin::render(const OFX::RenderArguments &args)
         return;
       }
       
-      //Create frame temp cache structure
-      std::map<std::size_t, FrameData> frameDataCache; 
-      
-      for(std::size_t output = 0; output < getNbConnectedInput(); ++output)
+      //Results are cached in full resolution pixels
+      if(imageScale != 1.0)
       {
-        std::cout << "render : [write] output  : " << output << std::endl;
-        std::size_t clipIndex = _connectedClipIdx[output];
-        
-        //Update frame temp cache
-        frameDataCache[clipIndex].extractedFeatures = dynamic_cast<const openMVG::features::SIFT_Regions*>(vecQueryRegions[output].get())->Features();
-        frameDataCache[clipIndex].localizationResult = mapLocResults[clipIndex];
-        frameDataCache[clipIndex].undistortedPt2D = mapLocResults[clipIndex].retrieveUndistortedPt2D();
-         
-        if(mapLocResults[clipIndex].isValid())
+        for(std::size_t input = 0; input < vecLocResults.size(); ++input)
         {
-          std::cout << "render : [write] update output UI parameters " << std::endl;
-          updateOutputParamAtTime(args.time, 
-                                  clipIndex, 
-                                  mapLocResults[clipIndex], 
-                                  frameDataCache[clipIndex].extractedFeatures);
-          
-          std::cout << "render : [write] update intrinsics " << std::endl;
-          mapIntrinsics[clipIndex] = mapLocResults[clipIndex].getIntrinsics();
+          vecLocResults[input] = rescaleLocalizationResult(vecLocResults[input], 1.0 / imageScale);
+          rescaleFeatures(1.0 / imageScale, vecFeatures[input]);
         }
       }
       
-      std::cout << "render : [cache] update with frame temp cache " << std::endl;
-      //Update cache with frame temp cache
+      std::cout << "render : [cache] update with frame results " << std::endl;
+      commitFrameResults(args.time, vecLocResults, vecFeatures, isDraft);
+      
+      if(!isDraft)
       {
-        if(hasFrameDataCache(args.time))
-        {
-          //Lock before updating the existing frame data
-          for(auto &outputDataCache : frameDataCache)
-          {
-            std::lock_guard<std::mutex> guard(_framesData[args.time][outputDataCache.first].mutex);
-             _framesData[args.time][outputDataCache.first] = outputDataCache.second;
-          }
-        }
-        else
-        {
-          //Create a new cache at this time
-          _framesData[args.time] = frameDataCache;
-        }
+        std::cout << "render : [write] update serialized data  " << std::endl;
+        //Update serialized data
+        serializeCacheData();
       }
-      
-      std::cout << "render : [write] update serialized data  " << std::endl;
-      //Update serialized data
-      serializeCacheData();
     }
   }
   catch(std::exception &e)
@@ -397,6 +456,18 @@ void CameraLocalizerPlugin::render(const OFX::RenderArguments &args)
     this->sendMessage(OFX::Message::eMessageError, "cameralocalization.render", e.what());
   }
   
+  //Read frame results
+  if(const FrameDataCache::FrameDataAtTimePtr framesDataAtTime = getFrameDataCache(args.time))
+  {
+    for(auto &inputFrameData : *framesDataAtTime)
+    {
+      mapLocResults[inputFrameData.first] = inputFrameData.second.localizationResult;
+      mapIntrinsics[inputFrameData.first] = inputFrameData.second.localizationResult.getIntrinsics(); //TODO: remove and read intrinsics from output parameters
+    }
+  }
+  
+  updateCacheStats();
+  
   //Update Overlay
   std::cout << "render : [overlay] redraw"  << std::endl;
   this->redrawOverlays();
@@ -414,9 +485,16 @@ void CameraLocalizerPlugin::render(const OFX::RenderArguments &args)
   // TODO: always undistort (fill vecIntrinsics from params)
   if(mapLocResults[outputClipIndex].isValid())
   {
-    openMVG::image::Image<unsigned char> undistortedImage;
+    const openMVG::image::Image<unsigned char> &imageGray = mapImageGray[outputClipIndex];
+    openMVG::image::Image<unsigned char> undistortedImage(imageGray.Width(), imageGray.Height());
     std::cout << "render : [output clip] compute undistorted "  << std::endl;
-    openMVG::cameras::UndistortImage(mapImageGray[outputClipIndex], &mapIntrinsics[outputClipIndex], undistortedImage);
+    //The output image is at render scale, the remap table has its size
+    const std::vector<double> params = rescaleIntrinsics(mapIntrinsics[outputClipIndex], args.renderScale.x).getParams();
+    const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 outputIntrinsics(imageGray.Width(), imageGray.Height(),
+                                                                         params[0], params[1], params[2],
+                                                                         params[3], params[4], params[5]);
+    Common::getUndistortMap(outputIntrinsics)->remapGRAY8(imageGray.data(), imageGray.Width(),
+                                                          undistortedImage.data(), undistortedImage.Width());
     std::cout << "render : [output clip] convert and copy "  << std::endl;
     convertGRAY8ToRGB32(undistortedImage, outputImage);
   }
@@ -450,6 +528,7 @@ void CameraLocalizerPlugin::changedClip(const OFX::InstanceChangedArgs &args, co
   if(args.reason != OFX::InstanceChangeReason::eChangeTime)
   {
     _uptodateParam = false;
+    _resetTracking = true;
     updateConnectedClipIndexCollection();
     updateCameraOutputIndexRange();
 
@@ -460,6 +539,36 @@ void CameraLocalizerPlugin::changedClip(const OFX::InstanceChangedArgs &args, co
 
 void CameraLocalizerPlugin::changedParam(const OFX::InstanceChangedArgs &args, const std::string &paramName)
 {
+  //The cache state and the database status don't change the localizer parameters
+  if(paramName == kParamCacheSerializedResults ||
+     paramName == kParamDatabaseStatus ||
+     paramName == kParamAdvancedCacheNbHits ||
+     paramName == kParamAdvancedCacheNbMisses ||
+     paramName == kParamAdvancedCacheResidentMemory)
+  {
+    return;
+  }
+  
+  //Cache folder, results not found before may be in the new folder
+  if(paramName == kParamAdvancedCacheFolder)
+  {
+    _framesData.setFolder(_cacheFolder->getValue());
+    if(_framesData.getState().empty() && !_serializedResults->getValue().empty())
+    {
+      openCacheData();
+      updateCacheStats();
+    }
+    return;
+  }
+  
+  //Cache memory budget
+  if(paramName == kParamAdvancedCacheMemoryBudget)
+  {
+    _framesData.setMemoryBudget(std::size_t(_cacheMemoryBudget->getValue()) * 1024 * 1024);
+    updateCacheStats();
+    return;
+  }
+
   //A parameter change
   _uptodateParam = false;
   
@@ -484,7 +593,7 @@ void CameraLocalizerPlugin::changedParam(const OFX::InstanceChangedArgs &args, c
     bfs::path matchPath = bfs::path(_reconstructionFile->getValue()).parent_path() / "_mvg_build" / "matches";
     if(bfs::is_directory(matchPath))
       _descriptorsFolder->setValue(matchPath.string());
-    _uptodateDescriptor = false;
+    startLocalizerLoading();
     return;
   }
   
@@ -493,7 +602,14 @@ void CameraLocalizerPlugin::changedParam(const OFX::InstanceChangedArgs &args, c
           || (paramName == kParamVoctreeFile) 
           || (paramName == kParamAdvancedVoctreeWeights))
   {
-    _uptodateDescriptor = false;
+    startLocalizerLoading();
+    return;
+  }
+  
+  //Tracking Mode change
+  if(paramName == kParamTrackingMode)
+  {
+    _resetTracking = true;
     return;
   }
   
@@ -535,7 +651,7 @@ void CameraLocalizerPlugin::changedParam(const OFX::InstanceChangedArgs &args, c
   //Tracking button
   if(paramName == kParamTrackingTrack)
   {
-    //TODO
+    track();
     return;
   }
   
@@ -614,15 +730,20 @@ void CameraLocalizerPlugin::calibrateRig()
   std::vector< std::vector<openMVG::localization::LocalizationResult> > dataPerCamera(getNbConnectedInput());
 
   //Collect cache data per camera
-  for(auto &framesDataAtTime : _framesData)
+  for(OfxTime time : _framesData.getTimes())
   {
-    assert(getNbConnectedInput() == framesDataAtTime.second.size());
-    for(std::size_t cameraIndex = 0; cameraIndex < framesDataAtTime.second.size(); ++cameraIndex)
+    const FrameDataCache::FrameDataAtTimePtr framesDataAtTime = _framesData.at(time);
+    if(!framesDataAtTime)
+    {
+      continue;
+    }
+    assert(getNbConnectedInput() == framesDataAtTime->size());
+    for(std::size_t cameraIndex = 0; cameraIndex < framesDataAtTime->size(); ++cameraIndex)
     {
-      auto &cameraFrameDataAtTime = framesDataAtTime.second[cameraIndex];
+      auto &cameraFrameDataAtTime = framesDataAtTime->at(cameraIndex);
       if(cameraFrameDataAtTime.isLocalized())
       {
-        dataPerCamera[cameraIndex].push_back(framesDataAtTime.second[cameraIndex].localizationResult);
+        dataPerCamera[cameraIndex].push_back(cameraFrameDataAtTime.localizationResult);
       }
     }
   }
@@ -750,7 +871,6 @@ void CameraLocalizerPlugin::reset()
   std::cout << "reset : [parameters] update" << std::endl;
   //Reset plugin parameters
   _uptodateParam = false;
-  _uptodateDescriptor = false;
   
   updateConnectedClipIndexCollection();
   
@@ -767,31 +887,49 @@ void CameraLocalizerPlugin::reset()
   
   _trackingButton->setEnabled(hasInput());
   
-  //Reset plugin cache
-  if(!_serializedResults->getValue().empty())
+  //Reset plugin cache, the cache file is read on first access
+  _draftFramesData.clear();
+  _framesData.setMemoryBudget(std::size_t(_cacheMemoryBudget->getValue()) * 1024 * 1024);
+  _framesData.setFolder(_cacheFolder->getValue());
+  openCacheData();
+  
+  //Warm up the localizer database while the artist works
+  startLocalizerLoading();
+}
+
+void CameraLocalizerPlugin::openCacheData()
+{
+  const std::string serializedResults = _serializedResults->getValue();
+  try
   {
-    std::size_t nbFrameInCache = 0; //Only for prints
-    std::cout << "reset : [cache] load serialized data" << std::endl;
-    try
+    if(FrameDataCache::isLegacyState(serializedResults))
     {
-      std::istringstream serializedData(_serializedResults->getValue());
-      cereal::XMLInputArchive archive(serializedData);
-      archive(_framesData);
-      for(auto &framesDataAtTime : _framesData)
+      std::cout << "reset : [cache] convert XML serialized data" << std::endl;
+      std::map<OfxTime, FrameDataCache::FrameDataAtTime> framesData;
+      {
+        std::istringstream serializedData(serializedResults);
+        cereal::XMLInputArchive archive(serializedData);
+        archive(framesData);
+      }
+      for(auto &framesDataAtTime : framesData)
       {
         for(auto &cameraframeDataAtTime : framesDataAtTime.second)
         {
-          ++nbFrameInCache;
           cameraframeDataAtTime.second.undistortedPt2D = cameraframeDataAtTime.second.localizationResult.retrieveUndistortedPt2D();
         }
       }
-      std::cout << "reset : [cache] " << nbFrameInCache << " frames loaded in cache from serialized data" << std::endl;
+      _framesData.importFrames(framesData);
+      serializeCacheData();
     }
-    catch(std::exception &e)
+    else
     {
-      this->sendMessage(OFX::Message::eMessageWarning, "cameralocalization.reset.serializedresults", "Can't load serialized results : " + std::string(e.what()));
+      _framesData.open(serializedResults);
     }
-
+  }
+  catch(std::exception &e)
+  {
+    _framesData.open(std::string());
+    this->sendMessage(OFX::Message::eMessageError, "cameralocalization.reset.serializedresults", "Can't load the localization results : " + std::string(e.what()));
   }
 }
 
@@ -808,12 +946,26 @@ void CameraLocalizerPlugin::reset()
 
 void CameraLocalizerPlugin::serializeCacheData()
 {
-  std::stringstream serializedData;
+  const std::string state = _framesData.getState();
+  if(_serializedResults->getValue() != state)
   {
-    cereal::XMLOutputArchive archive( serializedData );
-    archive( CEREAL_NVP(_framesData) );
+    _serializedResults->setValue(state);
   }
-  _serializedResults->setValue( serializedData.str() );
+}
+
+void CameraLocalizerPlugin::updateCacheStats()
+{
+  const FrameDataCache::Stats stats = _framesData.getStats();
+  const std::string nbHits = std::to_string(stats.nbHits);
+  const std::string nbMisses = std::to_string(stats.nbMisses);
+  const std::string residentMemory = std::to_string(stats.residentBytes / (1024 * 1024)) + " MB (" + std::to_string(stats.nbResidentFrames) + " frames)";
+
+  if(_cacheNbHits->getValue() != nbHits)
+    _cacheNbHits->setValue(nbHits);
+  if(_cacheNbMisses->getValue() != nbMisses)
+    _cacheNbMisses->setValue(nbMisses);
+  if(_cacheResidentMemory->getValue() != residentMemory)
+    _cacheResidentMemory->setValue(residentMemory);
 }
 
 void CameraLocalizerPlugin::updateConnectedClipIndexCollection()
@@ -990,29 +1142,350 @@ bool CameraLocalizerPlugin::getInputIntrinsics(double time, std::size_t clipInde
 
 bool CameraLocalizerPlugin::getInputsInGrayScale(double time, std::map< std::size_t, openMVG::image::Image<unsigned char> > &mapInputImage)
 {
+  //Forget the buffers of the disconnected clips
+  for(auto it = mapInputImage.begin(); it != mapInputImage.end();)
+  {
+    if(std::find(_connectedClipIdx.begin(), _connectedClipIdx.end(), it->first) == _connectedClipIdx.end())
+      it = mapInputImage.erase(it);
+    else
+      ++it;
+  }
+
   for(std::size_t input = 0; input < getNbConnectedInput(); ++input)
   {
     std::size_t clipIndex = _connectedClipIdx[input];
-    OFX::Image *inputPtr = _srcClip[clipIndex]->fetchImage(time);
+    std::unique_ptr<OFX::Image> inputPtr(_srcClip[clipIndex]->fetchImage(time));
 
-    if(inputPtr == NULL)
+    if(!inputPtr)
     {
       return false;
     }
 
-    Common::Image<float> inputImage(inputPtr, Common::eOrientationTopDown);
-    mapInputImage[clipIndex] = openMVG::image::Image<unsigned char>(inputImage.getWidth(), inputImage.getHeight());
-    
-    if(_inputIsGrayscale[clipIndex]->getValue())
+    convertInputToGrayScale(inputPtr.get(), _inputIsGrayscale[clipIndex]->getValue(), mapInputImage[clipIndex]);
+  }
+  return true;
+}
+
+void CameraLocalizerPlugin::convertInputToGrayScale(OFX::Image *inputPtr, bool isGrayscale, openMVG::image::Image<unsigned char> &imageGray)
+{
+  const OfxRectI &bounds = inputPtr->getBounds();
+  const std::size_t width = bounds.x2 - bounds.x1;
+  const std::size_t height = bounds.y2 - bounds.y1;
+
+  //Only reallocated when the clip resolution changes
+  if(static_cast<std::size_t>(imageGray.Width()) != width || static_cast<std::size_t>(imageGray.Height()) != height)
+  {
+    imageGray = openMVG::image::Image<unsigned char>(width, height);
+  }
+
+  const Common::EGrayConversion conversion = isGrayscale ? Common::eGrayFromFirstChannel : Common::eGrayFromRGB;
+  const std::size_t nbChannels = inputPtr->getPixelComponentCount();
+  const char *pixelData = static_cast<const char*>(inputPtr->getPixelData());
+  const std::ptrdiff_t rowBytes = inputPtr->getRowBytes();
+
+  //OFX rows are bottom-up
+  for(std::size_t row = 0; row < height; ++row)
+  {
+    const float *src = reinterpret_cast<const float*>(pixelData + static_cast<std::ptrdiff_t>(height - 1 - row) * rowBytes);
+    Common::convertRowToGRAY8(src, width, nbChannels, conversion, &imageGray(row, 0));
+  }
+}
+
+void CameraLocalizerPlugin::getFrameQuery(double time,
+                                          const std::vector< std::pair<std::size_t, std::size_t> > &vecImageSize,
+                                          FrameQuery &query,
+                                          double imageScale)
+{
+  const std::size_t nbInputs = getNbConnectedInput();
+
+  query.time = time;
+  query.useRig = isRigInInput() && !isRigModeUnknown();
+  query.vecImageSize = vecImageSize;
+  query.vecHasIntrinsics.resize(nbInputs);
+  query.vecIntrinsics.clear();
+  query.vecSubPoses.resize(nbInputs - 1);
+
+  for(std::size_t input = 0; input < nbInputs; ++input)
+  {
+    std::size_t clipIndex = _connectedClipIdx[input];
+
+    if(input > 0) //We don't save the main camera relative pose (for the moment)
+    {
+      getInputSubPose(clipIndex, query.vecSubPoses[input - 1]);
+    }
+    //Input intrinsics are in full resolution pixels
+    query.vecIntrinsics.emplace_back(std::round(vecImageSize[input].first / imageScale), std::round(vecImageSize[input].second / imageScale)); //TODO : Change for different camera type
+    query.vecHasIntrinsics[input] = getInputIntrinsics(time, clipIndex, query.vecIntrinsics[input]);
+    if(imageScale != 1.0)
+    {
+      query.vecIntrinsics[input] = rescaleIntrinsics(query.vecIntrinsics[input], imageScale);
+    }
+  }
+}
+
+void CameraLocalizerPlugin::commitFrameResults(double time,
+                                               std::vector<openMVG::localization::LocalizationResult> &vecLocResults,
+                                               std::vector< std::vector<openMVG::features::SIOPointFeature> > &vecFeatures,
+                                               bool isDraft)
+{
+  //Create frame temp cache structure
+  std::map<std::size_t, FrameData> frameDataCache;
+
+  for(std::size_t output = 0; output < getNbConnectedInput(); ++output)
+  {
+    std::size_t clipIndex = _connectedClipIdx[output];
+    FrameData &frameData = frameDataCache[clipIndex];
+
+    //Update frame temp cache
+    frameData.extractedFeatures = std::move(vecFeatures[output]);
+    frameData.localizationResult = std::move(vecLocResults[output]);
+    frameData.undistortedPt2D = frameData.localizationResult.retrieveUndistortedPt2D();
+
+    if(!isDraft && frameData.localizationResult.isValid())
+    {
+      updateOutputParamAtTime(time,
+                              clipIndex,
+                              frameData.localizationResult,
+                              frameData.extractedFeatures);
+    }
+  }
+
+  //Update cache with frame temp cache
+  if(isDraft)
+  {
+    _draftFramesData.set(time, frameDataCache);
+  }
+  else
+  {
+    _framesData.set(time, frameDataCache);
+    _draftFramesData.erase(time);
+  }
+}
+
+void CameraLocalizerPlugin::track()
+{
+  if(!hasInput())
+  {
+    return;
+  }
+
+  if(!_uptodateParam)
+  {
+    parametersSetup();
+    _uptodateParam = true;
+  }
+
+  progressStart("Loading localizer database");
+  //Kept alive until the end of the tracking
+  const std::shared_ptr<openMVG::localization::ILocalizer> localizer = waitLocalizerLoading([this]() { return !progressUpdate(0.0); });
+  progressEnd();
+  if(!localizer)
+  {
+    return;
+  }
+
+  if(!localizer->isInit())
+  {
+    sendMessage(OFX::Message::eMessageError, "cameralocalization.track", "Cannot initialize the camera localizer.");
+    return;
+  }
+
+  //Frame range
+  int first;
+  int last;
+  if(static_cast<EParamTrackingRangeMode>(_trackingRangeMode->getValue()) == eParamRangeFromInputs)
+  {
+    //Frames available on all the inputs
+    OfxRangeD range = _srcClip[_connectedClipIdx[0]]->getFrameRange();
+    for(std::size_t clipIndex : _connectedClipIdx)
+    {
+      const OfxRangeD clipRange = _srcClip[clipIndex]->getFrameRange();
+      range.min = std::max(range.min, clipRange.min);
+      range.max = std::min(range.max, clipRange.max);
+    }
+    first = static_cast<int>(std::ceil(range.min));
+    last = static_cast<int>(std::floor(range.max));
+  }
+  else
+  {
+    first = _trackingRangeMin->getValue();
+    last = _trackingRangeMax->getValue();
+  }
+
+  if(first > last)
+  {
+    sendMessage(OFX::Message::eMessageError, "cameralocalization.track", "Invalid tracking range.");
+    return;
+  }
+
+  //Host calls (image fetch, params, cache) stay on this thread, the input images are converted
+  //to gray and released at fetch: jobs in flight only keep 8-bit images.
+  //Workers only do the features extraction and the localization.
+  //When tracking, each frame needs the previous one: frames are localized here in time order,
+  //and with the optical flow the features extraction is also done here, only on keyframes.
+  struct TrackJob
+  {
+    OfxTime time;
+    std::map< std::size_t, openMVG::image::Image<unsigned char> > mapImageGray;
+    std::vector< std::unique_ptr<openMVG::features::Regions> > vecQueryRegions;
+    FrameQuery query;
+    std::vector<openMVG::localization::LocalizationResult> vecLocResults;
+    std::vector< std::vector<openMVG::features::SIOPointFeature> > vecFeatures;
+    std::future<void> done;
+  };
+
+  Common::ThreadPool pool(_nbThreads->getValue());
+  const std::size_t maxJobsInFlight = 2 * pool.getNbThreads();
+  const std::size_t nbFrames = last - first + 1;
+  const bool alwaysCompute = _alwaysComputeFrame->getValue();
+  std::lock_guard<std::mutex> trackingLock(_trackingMutex);
+  FrameTracking *tracking = getFrameTracking();
+
+  std::vector<bool> isGrayscale;
+  for(std::size_t clipIndex : _connectedClipIdx)
+  {
+    isGrayscale.push_back(_inputIsGrayscale[clipIndex]->getValue());
+  }
+
+  std::deque< std::unique_ptr<TrackJob> > jobs;
+  std::vector< std::map< std::size_t, openMVG::image::Image<unsigned char> > > freeImagesGray; //recycled between jobs
+  std::size_t nbFramesDone = 0;
+  bool canceled = false;
+  std::string errorMessage;
+
+  //Wait for the oldest job and commit its results
+  auto commitOldestJob = [&]()
+  {
+    std::unique_ptr<TrackJob> job = std::move(jobs.front());
+    jobs.pop_front();
+    try
+    {
+      job->done.get();
+      if(errorMessage.empty())
+      {
+        if(tracking && tracking->param.useOpticalFlow)
+        {
+          _processData.localizeFrame(*localizer, job->mapImageGray, job->query, pool.getNbThreads(), job->vecLocResults, job->vecFeatures, tracking);
+        }
+        else if(tracking)
+        {
+          _processData.localizeRegions(*localizer, job->vecQueryRegions, job->query, job->vecLocResults, job->vecFeatures, tracking);
+        }
+        commitFrameResults(job->time, job->vecLocResults, job->vecFeatures);
+      }
+    }
+    catch(std::exception &e)
+    {
+      if(errorMessage.empty())
+      {
+        errorMessage = e.what();
+      }
+    }
+    freeImagesGray.push_back(std::move(job->mapImageGray));
+    ++nbFramesDone;
+  };
+
+  std::cout << "track : [info] frames " << first << " to " << last << " on " << pool.getNbThreads() << " threads" << std::endl;
+  progressStart("Camera localization tracking");
+
+  for(int frame = first; frame <= last && !canceled && errorMessage.empty(); ++frame)
+  {
+    const OfxTime time = frame;
+
+    //A frame that can't be loaded from the cache file is computed again
+    if(alwaysCompute || !_framesData.has(time) || !_framesData.at(time))
     {
-      convertGGG32ToGRAY8(inputImage, mapInputImage[clipIndex]);
+      std::unique_ptr<TrackJob> job(new TrackJob());
+      job->time = time;
+      if(!freeImagesGray.empty())
+      {
+        job->mapImageGray = std::move(freeImagesGray.back());
+        freeImagesGray.pop_back();
+      }
+
+      //Fetch input images, only their gray version is kept
+      std::vector< std::pair<std::size_t, std::size_t> > vecImageSize;
+      for(std::size_t input = 0; input < getNbConnectedInput(); ++input)
+      {
+        const std::size_t clipIndex = _connectedClipIdx[input];
+        std::unique_ptr<OFX::Image> inputPtr(_srcClip[clipIndex]->fetchImage(time));
+        if(!inputPtr)
+        {
+          break;
+        }
+        openMVG::image::Image<unsigned char> &imageGray = job->mapImageGray[clipIndex];
+        convertInputToGrayScale(inputPtr.get(), isGrayscale[input], imageGray);
+        vecImageSize.emplace_back(imageGray.Width(), imageGray.Height());
+      }
+
+      if(vecImageSize.size() != getNbConnectedInput())
+      {
+        std::cerr << "track : [error] can't collect images in input at frame " << frame << std::endl;
+        ++nbFramesDone;
+      }
+      else
+      {
+        getFrameQuery(time, vecImageSize, job->query);
+
+        TrackJob *jobPtr = job.get();
+        job->done = pool.submit([this, jobPtr, tracking, localizer]()
+        {
+          //Frames are already processed in parallel
+          if(tracking && tracking->param.useOpticalFlow)
+          {
+            return;
+          }
+          if(tracking)
+          {
+            jobPtr->vecQueryRegions.resize(jobPtr->mapImageGray.size());
+            _processData.extractFeatures(jobPtr->mapImageGray, jobPtr->vecQueryRegions, 1);
+          }
+          else
+          {
+            _processData.localizeFrame(*localizer, jobPtr->mapImageGray, jobPtr->query, 1, jobPtr->vecLocResults, jobPtr->vecFeatures);
+          }
+        });
+        jobs.push_back(std::move(job));
+      }
     }
     else
     {
-      convertRGB32ToGRAY8(inputImage, mapInputImage[clipIndex]);
+      ++nbFramesDone;
+    }
+
+    //Commit in time order, keep the workers busy
+    while(jobs.size() >= maxJobsInFlight || (frame == last && !jobs.empty()))
+    {
+      commitOldestJob();
+    }
+
+    if(!progressUpdate(double(nbFramesDone) / double(nbFrames)))
+    {
+      canceled = true;
     }
   }
-  return true;
+
+  //Wait for the jobs in flight after a cancel
+  while(!jobs.empty())
+  {
+    commitOldestJob();
+  }
+
+  progressEnd();
+
+  std::cout << "track : [write] update serialized data  " << std::endl;
+  serializeCacheData();
+  updateCacheStats();
+
+  if(!errorMessage.empty())
+  {
+    sendMessage(OFX::Message::eMessageError, "cameralocalization.track", errorMessage);
+  }
+
+  std::cout << "track : [info] " << nbFramesDone << " / " << nbFrames << " frames done" << (canceled ? " (canceled)" : "") << std::endl;
+
+  redrawOverlays();
+  invalidRender();
 }
 
 } //namespace Localizer
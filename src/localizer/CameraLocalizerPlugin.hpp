@@ -1,9 +1,15 @@
 #pragma once
 #include "ofxsImageEffect.h"
 #include "CameraLocalizer.hpp"
+#include "CameraLocalizerCache.hpp"
+#include "CameraLocalizerDatabase.hpp"
 #include "CameraLocalizerPluginFactory.hpp"
 #include "CameraLocalizerPluginDefinition.hpp"
 
+#include <atomic>
+#include <functional>
+#include <mutex>
+
 //Maximum number of input clip 
 #define K_MAX_INPUTS 5
 
@@ -49,6 +55,7 @@ private:
   OFX::StringParam *_reconstructionFile = fetchStringParam(kParamReconstructionFile);
   OFX::StringParam *_descriptorsFolder = fetchStringParam(kParamDescriptorsFolder);
   OFX::StringParam *_voctreeFile = fetchStringParam(kParamVoctreeFile);
+  OFX::StringParam *_databaseStatus = fetchStringParam(kParamDatabaseStatus);
   OFX::ChoiceParam *_rigMode = fetchChoiceParam(kParamRigMode);
   OFX::PushButtonParam *_rigCalibration = fetchPushButtonParam(kParamRigCalibration);
   OFX::StringParam *_rigCalibrationFile = fetchStringParam(kParamRigCalibrationFile);
@@ -79,6 +86,8 @@ private:
   OFX::IntParam *_baMinPointVisibility = fetchIntParam(kParamAdvancedBaMinPointVisibility);
   OFX::DoubleParam *_distanceRatio = fetchDoubleParam(kParamAdvancedDistanceRatio);
   OFX::BooleanParam *_useGuidedMatching = fetchBooleanParam(kParamAdvancedUseGuidedMatching);
+  OFX::IntParam *_nbThreads = fetchIntParam(kParamAdvancedNbThreads);
+  OFX::DoubleParam *_proxyScale = fetchDoubleParam(kParamAdvancedProxyScale);
   OFX::StringParam *_debugFolder = fetchStringParam(kParamAdvancedDebugFolder);
   OFX::BooleanParam *_alwaysComputeFrame = fetchBooleanParam(kParamAdvancedDebugAlwaysComputeFrame);  
   
@@ -88,7 +97,17 @@ private:
   OFX::StringParam *_sfMDataNbStructures = fetchStringParam(kParamAdvancedSfMDataNbStructures);
   OFX::StringParam *_sfMDataNbControlPoints = fetchStringParam(kParamAdvancedSfMDataNbControlPoints);
   
+  OFX::IntParam *_cacheMemoryBudget = fetchIntParam(kParamAdvancedCacheMemoryBudget);
+  OFX::StringParam *_cacheFolder = fetchStringParam(kParamAdvancedCacheFolder);
+  OFX::StringParam *_cacheNbHits = fetchStringParam(kParamAdvancedCacheNbHits);
+  OFX::StringParam *_cacheNbMisses = fetchStringParam(kParamAdvancedCacheNbMisses);
+  OFX::StringParam *_cacheResidentMemory = fetchStringParam(kParamAdvancedCacheResidentMemory);
+  
   //Tracking Parameters
+  OFX::ChoiceParam *_trackingMode = fetchChoiceParam(kParamTrackingMode);
+  OFX::IntParam *_trackingMinInliers = fetchIntParam(kParamTrackingMinInliers);
+  OFX::DoubleParam *_trackingSearchRadius = fetchDoubleParam(kParamTrackingSearchRadius);
+  OFX::IntParam *_trackingMinTracks = fetchIntParam(kParamTrackingMinTracks);
   OFX::ChoiceParam *_trackingRangeMode = fetchChoiceParam(kParamTrackingRangeMode);
   OFX::IntParam *_trackingRangeMin = fetchIntParam(kParamTrackingRangeMin);
   OFX::IntParam *_trackingRangeMax = fetchIntParam(kParamTrackingRangeMax);
@@ -125,7 +144,23 @@ private:
   //Process Data
   LocalizerProcessData _processData;
   bool _uptodateParam = false;
-  bool _uptodateDescriptor = false;
+
+  //Localizer database loading
+  //The UI thread only requests a database, the render and track threads swap it in
+  mutable std::mutex _localizerMutex;
+  LocalizerDatabaseKey _databaseKey; //requested database
+  bool _hasDatabaseKey = false;
+  bool _databaseChanged = false; //the requested database is not swapped in yet
+  SharedLocalizerFuture _localizerLoading;
+  std::shared_ptr<openMVG::localization::ILocalizer> _localizer; //shared between instances, see getSharedLocalizerAsync
+  
+  //Previous frame tracking state, only used by the render and the track under _trackingMutex
+  std::mutex _trackingMutex;
+  FrameTracking _tracking;
+  std::atomic<bool> _resetTracking{false}; //set by the UI thread, see getFrameTracking
+
+  //Grayscale input buffers, reused between renders
+  std::map<std::size_t, openMVG::image::Image<unsigned char> > _inputsGray;
 
   //Connected clip index vector
   std::vector<std::size_t> _connectedClipIdx;
@@ -134,7 +169,8 @@ private:
   std::vector<OFX::ValueParam*> _outputParams;
 
   //Cache
-  std::map<OfxTime, std::map<std::size_t, FrameData> > _framesData;
+  FrameDataCache _framesData;
+  DraftFrameDataCache _draftFramesData; //proxy results, not serialized
 
 public:
   
@@ -148,6 +184,26 @@ public:
    * @brief Update if needed the localizer param data structure
    */
   void parametersSetup();
+  
+  /**
+   * @brief Get the tracking state if the tracking mode is enabled
+   * Applies the tracking reset requested by the UI thread, _trackingMutex must be locked
+   * @return the tracking state, or nullptr
+   */
+  FrameTracking* getFrameTracking();
+  
+  /**
+   * @brief Request the localizer database and start loading it in background if its files changed
+   * Called from the UI thread, the current localizer stays in use until a render or a track swaps it
+   */
+  void startLocalizerLoading();
+  
+  /**
+   * @brief Wait for the requested localizer database and swap it in
+   * @param[in] isCanceled - polled while waiting, stop waiting if it returns true
+   * @return the localizer to use, or nullptr if it is not loaded
+   */
+  std::shared_ptr<openMVG::localization::ILocalizer> waitLocalizerLoading(const std::function<bool()> &isCanceled);
 
   /**
    * @brief Set regin of definition for the right input
@@ -226,10 +282,22 @@ public:
   void clearAllRelativePoses();
   
   /**
-   * @brief serialize cache data
+   * @brief Open the cache described by the serialized results parameter
+   * Results from the former XML serialization are converted. An error message
+   * is shown if the cache file can't be found.
+   */
+  void openCacheData();
+  
+  /**
+   * @brief Store the cache file state in the serialized results parameter
    */
   void serializeCacheData();
   
+  /**
+   * @brief Update the cache information parameters
+   */
+  void updateCacheStats();
+  
   /**
    * @brief Update the member connected clip index collection
    */
@@ -298,12 +366,54 @@ public:
   
   /**
    * @brief Set a map of grayscale image from input
+   * The images of mapInputImage are only reallocated if the input size changes.
    * @param[in] time
-   * @param[out] mapInputImage
+   * @param[in,out] mapInputImage
    * @return 
    */
   bool getInputsInGrayScale(double time, std::map< std::size_t, openMVG::image::Image<unsigned char> > &mapInputImage);
 
+  /**
+   * @brief Convert an input image to grayscale
+   * Doesn't call the host, can be used from a worker thread.
+   * @param[in] inputPtr
+   * @param[in] isGrayscale - the input is a GGG image
+   * @param[in,out] imageGray - reallocated only if its size differs from the input
+   */
+  static void convertInputToGrayScale(OFX::Image *inputPtr, bool isGrayscale, openMVG::image::Image<unsigned char> &imageGray);
+
+  /**
+   * @brief Collect the localization inputs of all the connected clips at the given time
+   * @param[in] time
+   * @param[in] vecImageSize - one size per connected input
+   * @param[out] query
+   * @param[in] imageScale - scale of the localized images relative to the full resolution
+   */
+  void getFrameQuery(double time,
+                     const std::vector< std::pair<std::size_t, std::size_t> > &vecImageSize,
+                     FrameQuery &query,
+                     double imageScale = 1.0);
+
+  /**
+   * @brief Store the localization results of a frame in the cache and the output parameters
+   * The results are moved into the cache. The serialized data is not updated.
+   * Draft results are only stored in the draft cache, full resolution results replace them.
+   * @param[in] time
+   * @param[in,out] vecLocResults - one result per connected input
+   * @param[in,out] vecFeatures - one features collection per connected input
+   * @param[in] isDraft - results of a proxy localization
+   */
+  void commitFrameResults(double time,
+                          std::vector<openMVG::localization::LocalizationResult> &vecLocResults,
+                          std::vector< std::vector<openMVG::features::SIOPointFeature> > &vecFeatures,
+                          bool isDraft = false);
+
+  /**
+   * @brief Localize all the frames of the tracking range
+   * Frames are processed in parallel and committed in time order.
+   */
+  void track();
+
   
   std::size_t getNbConnectedInput() const
   {
@@ -326,19 +436,40 @@ public:
     return _overlayFeaturesScaleOrientationRadius->getValue();
   }
   
-  const std::map<std::size_t, FrameData> &getFrameDataCache(OfxTime time) const
+  /**
+   * @brief Get the results of a frame, held by the returned pointer
+   * @param[in] time
+   * @return null if the frame has no results, or they can't be loaded
+   */
+  FrameDataCache::FrameDataAtTimePtr getFrameDataCache(OfxTime time) const
+  {
+    if(_framesData.has(time))
+    {
+      if(FrameDataCache::FrameDataAtTimePtr framesDataAtTime = _framesData.at(time))
+        return framesDataAtTime;
+    }
+    if(_draftFramesData.has(time))
+      return _draftFramesData.at(time);
+    return FrameDataCache::FrameDataAtTimePtr();
+  }
+  
+  std::shared_ptr<const FrameData> getOutputFrameDataCache(OfxTime time) const
   {
-    return _framesData.at(time);
+    const FrameDataCache::FrameDataAtTimePtr framesDataAtTime = getFrameDataCache(time);
+    if(!framesDataAtTime)
+      return std::shared_ptr<const FrameData>();
+    return std::shared_ptr<const FrameData>(framesDataAtTime, &framesDataAtTime->at(_cameraOutputIndex->getValue() - 1));
   }
   
-  const FrameData& getOutputFrameDataCache(OfxTime time) const
+  bool isDraftFrameDataCache(OfxTime time) const
   {
-    return _framesData.at(time).at(_cameraOutputIndex->getValue() - 1);
+    return !_framesData.has(time) && _draftFramesData.has(time);
   }
   
-  const openMVG::sfm::SfM_Data& getLocalizerSfMData() const
+  std::shared_ptr<const openMVG::localization::ILocalizer> getLocalizer() const
   {
-    return _processData.localizer->getSfMData();
+    std::lock_guard<std::mutex> lock(_localizerMutex);
+    return _localizer;
   }
     
   bool hasOverlayDetectedFeatures() const
@@ -383,7 +514,7 @@ public:
   
   bool hasFrameDataCache(OfxTime time) const
   {
-    return _framesData.find(time) != _framesData.end();
+    return _framesData.has(time) || _draftFramesData.has(time);
   }
 
   bool hasAllOutputParamKey(OfxTime time) const
@@ -434,7 +565,7 @@ public:
     _framesData.clear();
     for(OFX::ValueParam* outputParam: _outputParams)
       outputParam->deleteAllKeys();
-    _serializedResults->setValue("");
+    serializeCacheData();
   }
 };
 
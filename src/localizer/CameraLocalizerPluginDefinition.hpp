@@ -19,6 +19,7 @@
 #define kParamReconstructionFile "reconstructionFile"
 #define kParamDescriptorsFolder "descriptorsFolder"
 #define kParamVoctreeFile "voctreeFile"
+#define kParamDatabaseStatus "databaseStatus"
 #define kParamRigMode "rigMode"
 #define kParamRigCalibration "rigCalibration"
 #define kParamRigCalibrationFile "rigCalibrationFile"
@@ -83,6 +84,8 @@
 #define kParamAdvancedBaMinPointVisibility "advancedBaMinPointVisibility"
 #define kParamAdvancedDistanceRatio "advancedDistanceRatio"
 #define kParamAdvancedUseGuidedMatching "advancedUseGuidedMatching"
+#define kParamAdvancedNbThreads "advancedNbThreads"
+#define kParamAdvancedProxyScale "advancedProxyScale"
 #define kParamAdvancedDebugFolder "advancedDebugFolder"
 #define kParamAdvancedDebugAlwaysComputeFrame "advancedDebugAlwaysComputeFrame"
 
@@ -94,11 +97,24 @@
 #define kParamAdvancedSfMDataNbStructures "advancedSfMDataNbStructures"
 #define kParamAdvancedSfMDataNbControlPoints "advancedSfMDataNbControlPoints"
 
+#define kParamAdvancedCacheMemoryBudget "advancedCacheMemoryBudget"
+#define kParamAdvancedCacheFolder "advancedCacheFolder"
+
+#define kParamAdvancedGroupCache "groupAdvancedCache"
+
+#define kParamAdvancedCacheNbHits "advancedCacheNbHits"
+#define kParamAdvancedCacheNbMisses "advancedCacheNbMisses"
+#define kParamAdvancedCacheResidentMemory "advancedCacheResidentMemory"
+
 
 //Tracking Parameters
 #define kParamGroupTracking "groupTracking"
 
 #define kParamTrackingTrack "trackingTrack"
+#define kParamTrackingMode "trackingMode"
+#define kParamTrackingMinInliers "trackingMinInliers"
+#define kParamTrackingSearchRadius "trackingSearchRadius"
+#define kParamTrackingMinTracks "trackingMinTracks"
 #define kParamTrackingRangeMode "trackingRangeMode"
 #define kParamTrackingRangeMin "trackingRangeMin"
 #define kParamTrackingRangeMax "trackingRangeMax"
@@ -294,6 +310,20 @@ static const std::vector< std::pair<std::string, std::string> > kStringParamEsti
   {"LORansac", ""}
 };
 
+//kParamTrackingMode options
+enum EParamTrackingMode
+{
+    eParamTrackingModeNone = 0,
+    eParamTrackingModePreviousFrame,
+    eParamTrackingModeOpticalFlow
+};
+
+static const std::vector< std::pair<std::string, std::string> > kStringParamTrackingMode = { 
+  {"None", "Each frame is localized with a voctree query"},
+  {"Previous Frame", "The landmarks of the previous frame are matched around their reprojection, the voctree is only queried if not enough inliers are found"},
+  {"Optical Flow", "The landmarks of the previous frame are tracked with an optical flow, features are only extracted on keyframes"}
+};
+
 //kParamTrackingRangeMode options
 enum EParamTrackingRangeMode
 {
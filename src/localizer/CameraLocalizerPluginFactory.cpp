@@ -41,7 +41,7 @@ void CameraLocalizerPluginFactory::describe(OFX::ImageEffectDescriptor& desc)
   //Flags
   desc.setSingleInstance(false);
   desc.setHostFrameThreading(false);
-  desc.setSupportsMultiResolution(false);
+  desc.setSupportsMultiResolution(true);
   desc.setSupportsTiles(false);
   desc.setTemporalClipAccess(false);
   desc.setRenderTwiceAlways(false);
@@ -136,6 +136,16 @@ void CameraLocalizerPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
       if(voctreeFilepath)
         param->setDefault(voctreeFilepath);
       param->setParent(*groupMain);
+    }
+    
+    {
+      OFX::StringParamDescriptor *param = desc.defineStringParam(kParamDatabaseStatus);
+      param->setLabel("Database Status");
+      param->setHint("The localizer database is loaded in background when the reconstruction files change. Frames to compute wait until it is ready.");
+      param->setStringType(OFX::eStringTypeSingleLine);
+      param->setEvaluateOnChange(false);
+      param->setEnabled(false);
+      param->setParent(*groupMain);
       param->setLayoutHint(OFX::eLayoutHintDivider);
     }
 
@@ -612,6 +622,30 @@ void CameraLocalizerPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
       param->setParent(*groupAdvanced);
     }
     
+    {
+      OFX::IntParamDescriptor *param = desc.defineIntParam(kParamAdvancedNbThreads);
+      param->setLabel("Nb Threads");
+      param->setHint("Number of worker threads used to extract the features of the inputs. If set to 0 it uses one thread per CPU core.");
+      param->setRange(0, 64);
+      param->setDisplayRange(0, 16);
+      param->setDefault(0);
+      param->setAnimates(false);
+      param->setEvaluateOnChange(false);
+      param->setParent(*groupAdvanced);
+    }
+    
+    {
+      OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamAdvancedProxyScale);
+      param->setLabel("Proxy Scale");
+      param->setHint("Maximum scale of the images localized for draft renders or renders below full resolution. Draft results are not saved and are replaced by the full resolution results.");
+      param->setRange(0.05, 1.0);
+      param->setDisplayRange(0.1, 1.0);
+      param->setDefault(0.5);
+      param->setAnimates(false);
+      param->setEvaluateOnChange(false);
+      param->setParent(*groupAdvanced);
+    }
+    
     {
       OFX::StringParamDescriptor *param = desc.defineStringParam(kParamAdvancedDebugFolder);
       param->setLabel("Debug Folder");
@@ -686,6 +720,66 @@ void CameraLocalizerPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
         param->setParent(*groupSfM);
       }
     }
+    
+    {
+      OFX::IntParamDescriptor *param = desc.defineIntParam(kParamAdvancedCacheMemoryBudget);
+      param->setLabel("Cache Memory Budget (MB)");
+      param->setHint("Maximum memory used by the detected features of the cached frames. Least recently used frames are reloaded from the cache file when needed. If set to 0 the memory is not limited.");
+      param->setRange(0, 65536);
+      param->setDisplayRange(0, 8192);
+      param->setDefault(1024);
+      param->setAnimates(false);
+      param->setEvaluateOnChange(false);
+      param->setParent(*groupAdvanced);
+    }
+    
+    {
+      OFX::StringParamDescriptor *param = desc.defineStringParam(kParamAdvancedCacheFolder);
+      param->setLabel("Cache Folder");
+      param->setHint("Folder of the localization cache files. Use a shared folder so that other artists and farm nodes find the results. If empty, the user cache folder is used.");
+      param->setStringType(OFX::eStringTypeDirectoryPath);
+      param->setEvaluateOnChange(false);
+      if(const char *cachePath = std::getenv("OFXMVG_CACHE_PATH"))
+        param->setDefault(cachePath);
+      param->setParent(*groupAdvanced);
+    }
+    
+    {
+      OFX::GroupParamDescriptor *groupCache = desc.defineGroupParam(kParamAdvancedGroupCache);
+      groupCache->setLabel("Cache Information");
+      groupCache->setOpen(false);
+      groupCache->setParent(*groupAdvanced);
+      
+      {
+        OFX::StringParamDescriptor *param = desc.defineStringParam(kParamAdvancedCacheNbHits);
+        param->setLabel("Nb Hits");
+        param->setHint("Number of cached frame accesses with the features in memory");
+        param->setStringType(OFX::eStringTypeSingleLine);
+        param->setEvaluateOnChange(false);
+        param->setEnabled(false);
+        param->setParent(*groupCache);
+      }
+      
+      {
+        OFX::StringParamDescriptor *param = desc.defineStringParam(kParamAdvancedCacheNbMisses);
+        param->setLabel("Nb Misses");
+        param->setHint("Number of cached frame accesses reloading data from the cache file");
+        param->setStringType(OFX::eStringTypeSingleLine);
+        param->setEvaluateOnChange(false);
+        param->setEnabled(false);
+        param->setParent(*groupCache);
+      }
+      
+      {
+        OFX::StringParamDescriptor *param = desc.defineStringParam(kParamAdvancedCacheResidentMemory);
+        param->setLabel("Resident Memory");
+        param->setHint("Memory used by the features of the cached frames");
+        param->setStringType(OFX::eStringTypeSingleLine);
+        param->setEvaluateOnChange(false);
+        param->setEnabled(false);
+        param->setParent(*groupCache);
+      }
+    }
   }
   
   //Tracking Group
@@ -694,6 +788,53 @@ void CameraLocalizerPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
     groupTracking->setLabel("Tracking");
     groupTracking->setAsTab();
     
+    {
+      OFX::ChoiceParamDescriptor *param = desc.defineChoiceParam(kParamTrackingMode);
+      param->setLabel("Tracking Mode");
+      param->setHint("Use the previous frame localization to localize the current frame. Only available without a calibrated rig.");
+      param->appendOptions(kStringParamTrackingMode);
+      param->setDefault(eParamTrackingModeNone);
+      param->setEvaluateOnChange(false);
+      param->setParent(*groupTracking);
+    }
+    
+    {
+      OFX::IntParamDescriptor *param = desc.defineIntParam(kParamTrackingMinInliers);
+      param->setLabel("Min Inliers");
+      param->setHint("Under this number of inliers, the frame is localized with a voctree query");
+      param->setDefault(30);
+      param->setRange(6, 1000);
+      param->setDisplayRange(6, 200);
+      param->setAnimates(false);
+      param->setEvaluateOnChange(false);
+      param->setParent(*groupTracking);
+    }
+    
+    {
+      OFX::DoubleParamDescriptor *param = desc.defineDoubleParam(kParamTrackingSearchRadius);
+      param->setLabel("Search Radius");
+      param->setHint("Features are matched in this radius (in pixels) around the reprojection of the previous frame landmarks");
+      param->setDefault(40.0);
+      param->setRange(1.0, 1000.0);
+      param->setDisplayRange(5.0, 200.0);
+      param->setAnimates(false);
+      param->setEvaluateOnChange(false);
+      param->setParent(*groupTracking);
+    }
+    
+    {
+      OFX::IntParamDescriptor *param = desc.defineIntParam(kParamTrackingMinTracks);
+      param->setLabel("Min Tracks");
+      param->setHint("Optical flow only: under this number of tracked points, features are extracted on a new keyframe");
+      param->setDefault(100);
+      param->setRange(6, 10000);
+      param->setDisplayRange(6, 500);
+      param->setAnimates(false);
+      param->setEvaluateOnChange(false);
+      param->setParent(*groupTracking);
+      param->setLayoutHint(OFX::eLayoutHintDivider);
+    }
+    
     {
       OFX::ChoiceParamDescriptor *param = desc.defineChoiceParam(kParamTrackingRangeMode);
       param->setLabel("Tracking Range");
@@ -1006,7 +1147,7 @@ void CameraLocalizerPluginFactory::describeInContext(OFX::ImageEffectDescriptor&
   {
     OFX::StringParamDescriptor *param = desc.defineStringParam(kParamCacheSerializedResults);
     param->setLabel("Localization Results Cache");
-    param->setHint("Allow the plugin to store serialized computed results");
+    param->setHint("Allow the plugin to find its localization cache file (path and content hash)");
     param->setIsSecret(true);
     param->setEnabled(false);
     param->setAnimates(true);
@@ -0,0 +1,329 @@
+#include "CameraLocalizerTracking.hpp"
+
+#include <openMVG/sfm/pipelines/localization/SfM_Localizer.hpp>
+
+#include <opencv2/video/tracking.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+
+namespace openMVG_ofx {
+namespace Localizer {
+
+namespace {
+
+std::uint32_t descriptorDistance(const openMVG::features::SIFT_Regions::DescriptorT &a,
+                                 const openMVG::features::SIFT_Regions::DescriptorT &b)
+{
+  std::uint32_t distance = 0;
+  for(std::size_t i = 0; i < openMVG::features::SIFT_Regions::DescriptorT::static_size; ++i)
+  {
+    const int diff = int(a[i]) - int(b[i]);
+    distance += diff * diff;
+  }
+  return distance;
+}
+
+/**
+ * @brief Estimate the pose from 2D-3D associations and fill the localization result
+ * @param[in,out] matchData - pt2D and pt3D set
+ * @param[in] indMatch3D2D
+ * @param[in] prior
+ * @param[in] imageSize
+ * @param[in] param
+ * @param[in] hasIntrinsics
+ * @param[in] queryIntrinsics
+ * @param[out] localizationResult
+ * @return true if localized with at least param.minInliers inliers
+ */
+bool resection(openMVG::sfm::Image_Localizer_Match_Data &matchData,
+               const std::vector<std::pair<openMVG::IndexT, openMVG::IndexT> > &indMatch3D2D,
+               const TrackingPrior &prior,
+               const std::pair<std::size_t, std::size_t> &imageSize,
+               const TrackingParameters &param,
+               bool hasIntrinsics,
+               const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &queryIntrinsics,
+               openMVG::localization::LocalizationResult &localizationResult)
+{
+  matchData.error_max = param.errorMax;
+
+  //Focal length and distortion are refined by the global localization only
+  openMVG::cameras::Pinhole_Intrinsic_Radial_K3 intrinsics = hasIntrinsics ? queryIntrinsics : prior.intrinsics;
+  openMVG::geometry::Pose3 pose;
+  const openMVG::Pair resectionImageSize(imageSize.first, imageSize.second);
+
+  if(!openMVG::sfm::SfM_Localizer::Localize(resectionImageSize, &intrinsics, matchData, pose, param.resectionEstimator))
+  {
+    return false;
+  }
+  if(matchData.vec_inliers.size() < param.minInliers)
+  {
+    std::cout << "[tracking]\tonly " << matchData.vec_inliers.size() << " inliers" << std::endl;
+    return false;
+  }
+  if(!openMVG::sfm::SfM_Localizer::RefinePose(&intrinsics, pose, matchData, true, false))
+  {
+    return false;
+  }
+
+  localizationResult = openMVG::localization::LocalizationResult(matchData, indMatch3D2D, pose, intrinsics, prior.matchedImages, true);
+  std::cout << "[tracking]\tlocalized with " << matchData.vec_inliers.size() << " inliers" << std::endl;
+  return true;
+}
+
+} //namespace
+
+void updateTrackingPrior(double time,
+                         const std::pair<std::size_t, std::size_t> &imageSize,
+                         const openMVG::localization::LocalizationResult &localizationResult,
+                         const std::vector<openMVG::features::SIOPointFeature> &features,
+                         const std::vector<openMVG::features::SIFT_Regions::DescriptorT> &descriptors,
+                         TrackingPrior &prior)
+{
+  prior = TrackingPrior();
+  if(!localizationResult.isValid())
+  {
+    return;
+  }
+
+  const std::vector<std::size_t> &inliers = localizationResult.getInliers();
+  const std::vector<std::pair<openMVG::IndexT, openMVG::IndexT> > &indMatch3D2D = localizationResult.getIndMatch3D2D();
+  const openMVG::Mat &pt3D = localizationResult.getPt3D();
+
+  prior.isValid = true;
+  prior.time = time;
+  prior.imageSize = imageSize;
+  prior.pose = localizationResult.getPose();
+  prior.intrinsics = localizationResult.getIntrinsics();
+  prior.matchedImages = localizationResult.getMatchedImages();
+  prior.pt3D.resize(3, inliers.size());
+  prior.landmarkIds.reserve(inliers.size());
+  prior.descriptors.reserve(inliers.size());
+  prior.pt2D.reserve(inliers.size());
+
+  for(std::size_t i = 0; i < inliers.size(); ++i)
+  {
+    const std::size_t match = inliers[i];
+    const openMVG::IndexT feature = indMatch3D2D[match].second;
+    prior.pt3D.col(i) = pt3D.col(match);
+    prior.landmarkIds.push_back(indMatch3D2D[match].first);
+    prior.descriptors.push_back(descriptors[feature]);
+    prior.pt2D.emplace_back(features[feature].x(), features[feature].y());
+  }
+}
+
+void buildTrackingPyramid(const openMVG::image::Image<unsigned char> &image,
+                          const TrackingParameters &param,
+                          std::vector<cv::Mat> &pyramid)
+{
+  //Wraps the image buffer, the pyramid doesn't reuse it
+  const cv::Mat imageMat(image.Height(), image.Width(), CV_8UC1, const_cast<unsigned char*>(image.data()));
+  cv::buildOpticalFlowPyramid(imageMat,
+                              pyramid,
+                              cv::Size(param.flowWindowSize, param.flowWindowSize),
+                              param.flowMaxLevel,
+                              true,
+                              cv::BORDER_REFLECT_101,
+                              cv::BORDER_CONSTANT,
+                              false);
+}
+
+bool localizeFromPrior(const TrackingPrior &prior,
+                       const openMVG::features::SIFT_Regions &queryRegions,
+                       const std::pair<std::size_t, std::size_t> &imageSize,
+                       const TrackingParameters &param,
+                       bool hasIntrinsics,
+                       const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &queryIntrinsics,
+                       openMVG::localization::LocalizationResult &localizationResult)
+{
+  if(!prior.isValid ||
+     prior.imageSize != imageSize ||
+     prior.landmarkIds.size() < param.minInliers)
+  {
+    return false;
+  }
+
+  const std::vector<openMVG::features::SIOPointFeature> &features = queryRegions.Features();
+  const std::vector<openMVG::features::SIFT_Regions::DescriptorT> &descriptors = queryRegions.Descriptors();
+
+  //Bucket the query features in cells of the search radius size
+  const double cellSize = std::max(1.0, param.searchRadius);
+  const int gridWidth = static_cast<int>(imageSize.first / cellSize) + 1;
+  const int gridHeight = static_cast<int>(imageSize.second / cellSize) + 1;
+  std::vector< std::vector<std::size_t> > grid(gridWidth * gridHeight);
+
+  for(std::size_t i = 0; i < features.size(); ++i)
+  {
+    const int x = static_cast<int>(features[i].x() / cellSize);
+    const int y = static_cast<int>(features[i].y() / cellSize);
+    if(x >= 0 && x < gridWidth && y >= 0 && y < gridHeight)
+    {
+      grid[y * gridWidth + x].push_back(i);
+    }
+  }
+
+  //Guided matching of the prior 3D points around their reprojection.
+  //A query feature is kept for its best matching landmark only.
+  const double searchRadius2 = param.searchRadius * param.searchRadius;
+  const double ratio2 = param.distanceRatio * param.distanceRatio;
+  std::vector<std::size_t> featureLandmark(features.size(), std::numeric_limits<std::size_t>::max());
+  std::vector<std::uint32_t> featureDistance(features.size(), std::numeric_limits<std::uint32_t>::max());
+
+  for(std::size_t landmark = 0; landmark < prior.landmarkIds.size(); ++landmark)
+  {
+    const openMVG::Vec3 point3D = prior.pt3D.col(landmark);
+    if(prior.pose.depth(point3D) <= 0)
+    {
+      continue;
+    }
+    const openMVG::Vec2 projected = prior.intrinsics.project(prior.pose, point3D);
+
+    const int cellX = static_cast<int>(std::floor(projected(0) / cellSize));
+    const int cellY = static_cast<int>(std::floor(projected(1) / cellSize));
+
+    std::uint32_t bestDistance = std::numeric_limits<std::uint32_t>::max();
+    std::uint32_t secondDistance = std::numeric_limits<std::uint32_t>::max();
+    std::size_t bestFeature = features.size();
+
+    for(int y = std::max(0, cellY - 1); y <= std::min(gridHeight - 1, cellY + 1); ++y)
+    {
+      for(int x = std::max(0, cellX - 1); x <= std::min(gridWidth - 1, cellX + 1); ++x)
+      {
+        for(std::size_t feature : grid[y * gridWidth + x])
+        {
+          if((features[feature].coords().cast<double>() - projected).squaredNorm() > searchRadius2)
+          {
+            continue;
+          }
+          const std::uint32_t distance = descriptorDistance(prior.descriptors[landmark], descriptors[feature]);
+          if(distance < bestDistance)
+          {
+            secondDistance = bestDistance;
+            bestDistance = distance;
+            bestFeature = feature;
+          }
+          else if(distance < secondDistance)
+          {
+            secondDistance = distance;
+          }
+        }
+      }
+    }
+
+    //Distances are squared
+    if(bestFeature == features.size() ||
+       (secondDistance != std::numeric_limits<std::uint32_t>::max() && bestDistance >= ratio2 * secondDistance))
+    {
+      continue;
+    }
+    if(bestDistance < featureDistance[bestFeature])
+    {
+      featureDistance[bestFeature] = bestDistance;
+      featureLandmark[bestFeature] = landmark;
+    }
+  }
+
+  //Collect the 2D-3D associations
+  std::vector<std::pair<openMVG::IndexT, openMVG::IndexT> > indMatch3D2D;
+  std::vector<std::size_t> matchedLandmarks;
+  for(std::size_t feature = 0; feature < features.size(); ++feature)
+  {
+    if(featureLandmark[feature] != std::numeric_limits<std::size_t>::max())
+    {
+      indMatch3D2D.emplace_back(prior.landmarkIds[featureLandmark[feature]], feature);
+      matchedLandmarks.push_back(featureLandmark[feature]);
+    }
+  }
+
+  std::cout << "[tracking]\t" << indMatch3D2D.size() << " / " << prior.landmarkIds.size() << " landmarks matched from frame " << prior.time << std::endl;
+  if(indMatch3D2D.size() < param.minInliers)
+  {
+    return false;
+  }
+
+  openMVG::sfm::Image_Localizer_Match_Data matchData;
+  matchData.pt3D.resize(3, indMatch3D2D.size());
+  matchData.pt2D.resize(2, indMatch3D2D.size());
+  for(std::size_t i = 0; i < indMatch3D2D.size(); ++i)
+  {
+    matchData.pt3D.col(i) = prior.pt3D.col(matchedLandmarks[i]);
+    matchData.pt2D.col(i) = features[indMatch3D2D[i].second].coords().cast<double>();
+  }
+
+  return resection(matchData, indMatch3D2D, prior, imageSize, param, hasIntrinsics, queryIntrinsics, localizationResult);
+}
+
+bool localizeFromOpticalFlow(const TrackingPrior &prior,
+                             const std::vector<cv::Mat> &pyramid,
+                             const std::pair<std::size_t, std::size_t> &imageSize,
+                             const TrackingParameters &param,
+                             bool hasIntrinsics,
+                             const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &queryIntrinsics,
+                             openMVG::localization::LocalizationResult &localizationResult,
+                             std::vector<openMVG::features::SIOPointFeature> &features,
+                             std::vector<openMVG::features::SIFT_Regions::DescriptorT> &descriptors)
+{
+  if(!prior.isValid ||
+     prior.pyramid.empty() ||
+     prior.imageSize != imageSize ||
+     prior.pt2D.size() < std::max(param.minTracks, param.minInliers))
+  {
+    return false;
+  }
+
+  const cv::Size windowSize(param.flowWindowSize, param.flowWindowSize);
+  std::vector<cv::Point2f> trackedPoints;
+  std::vector<cv::Point2f> backPoints;
+  std::vector<unsigned char> status;
+  std::vector<unsigned char> backStatus;
+  std::vector<float> error;
+
+  cv::calcOpticalFlowPyrLK(prior.pyramid, pyramid, prior.pt2D, trackedPoints, status, error, windowSize, param.flowMaxLevel);
+  cv::calcOpticalFlowPyrLK(pyramid, prior.pyramid, trackedPoints, backPoints, backStatus, error, windowSize, param.flowMaxLevel);
+
+  //Forward-backward check
+  const float maxError2 = static_cast<float>(param.flowMaxError * param.flowMaxError);
+  std::vector<std::pair<openMVG::IndexT, openMVG::IndexT> > indMatch3D2D;
+  std::vector<std::size_t> trackedLandmarks;
+  features.clear();
+  descriptors.clear();
+
+  for(std::size_t i = 0; i < trackedPoints.size(); ++i)
+  {
+    const cv::Point2f &point = trackedPoints[i];
+    const cv::Point2f backError = backPoints[i] - prior.pt2D[i];
+    if(!status[i] || !backStatus[i] ||
+       (backError.dot(backError) > maxError2) ||
+       point.x < 0.f || point.y < 0.f || point.x >= imageSize.first || point.y >= imageSize.second)
+    {
+      continue;
+    }
+    indMatch3D2D.emplace_back(prior.landmarkIds[i], features.size());
+    trackedLandmarks.push_back(i);
+    features.emplace_back(point.x, point.y, 1.f, 0.f);
+    descriptors.push_back(prior.descriptors[i]);
+  }
+
+  std::cout << "[tracking]\t" << features.size() << " / " << prior.pt2D.size() << " points tracked from frame " << prior.time << std::endl;
+  if(features.size() < std::max(param.minTracks, param.minInliers))
+  {
+    return false;
+  }
+
+  openMVG::sfm::Image_Localizer_Match_Data matchData;
+  matchData.pt3D.resize(3, indMatch3D2D.size());
+  matchData.pt2D.resize(2, indMatch3D2D.size());
+  for(std::size_t i = 0; i < indMatch3D2D.size(); ++i)
+  {
+    matchData.pt3D.col(i) = prior.pt3D.col(trackedLandmarks[i]);
+    matchData.pt2D.col(i) = features[i].coords().cast<double>();
+  }
+
+  return resection(matchData, indMatch3D2D, prior, imageSize, param, hasIntrinsics, queryIntrinsics, localizationResult);
+}
+
+} //namespace Localizer
+} //namespace openMVG_ofx
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <openMVG/localization/LocalizationResult.hpp>
+#include <openMVG/features/regions_factory.hpp>
+#include <openMVG/robust_estimation/robust_estimators.hpp>
+#include <openMVG/image/image_container.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+
+namespace openMVG_ofx {
+namespace Localizer {
+
+//TrackingParameters structure for the localization from the previous frame
+struct TrackingParameters
+{
+  std::size_t minInliers = 30;     //below, the frame is localized with a global voctree query
+  double searchRadius = 40.0;      //around the reprojected 3D points, in pixels
+  double distanceRatio = 0.8;      //descriptors ratio test
+  double errorMax = 4.0;           //resection reprojection error
+  openMVG::robust::EROBUST_ESTIMATOR resectionEstimator = openMVG::robust::ROBUST_ESTIMATOR_ACRANSAC;
+  
+  //Optical flow
+  bool useOpticalFlow = false;     //extract features on keyframes only
+  std::size_t minTracks = 100;     //below, a new keyframe is extracted
+  int flowWindowSize = 21;
+  int flowMaxLevel = 3;
+  double flowMaxError = 1.0;       //forward-backward tracking error, in pixels
+};
+
+//TrackingPrior structure for the inliers of the last localized frame of one input
+struct TrackingPrior
+{
+  bool isValid = false;
+  double time = 0.0;
+  std::pair<std::size_t, std::size_t> imageSize;
+  openMVG::geometry::Pose3 pose;
+  openMVG::cameras::Pinhole_Intrinsic_Radial_K3 intrinsics;
+  std::vector<openMVG::localization::voctree::DocMatch> matchedImages;
+  std::vector<openMVG::IndexT> landmarkIds;
+  openMVG::Mat pt3D;
+  std::vector<openMVG::features::SIFT_Regions::DescriptorT> descriptors;
+  std::vector<cv::Point2f> pt2D;   //landmarks observations
+  std::vector<cv::Mat> pyramid;    //only for the optical flow
+};
+
+//FrameTracking structure for the tracking state of all the inputs
+struct FrameTracking
+{
+  TrackingParameters param;
+  std::vector<TrackingPrior> priors; //one per input
+
+  void clear()
+  {
+    priors.clear();
+  }
+};
+
+/**
+ * @brief Keep the inliers of a localization result as prior for the next frame
+ * The prior pyramid is left empty.
+ * @param[in] time
+ * @param[in] imageSize
+ * @param[in] localizationResult
+ * @param[in] features - features used to localize the frame
+ * @param[in] descriptors - one per feature
+ * @param[out] prior - invalid if the frame isn't localized
+ */
+void updateTrackingPrior(double time,
+                         const std::pair<std::size_t, std::size_t> &imageSize,
+                         const openMVG::localization::LocalizationResult &localizationResult,
+                         const std::vector<openMVG::features::SIOPointFeature> &features,
+                         const std::vector<openMVG::features::SIFT_Regions::DescriptorT> &descriptors,
+                         TrackingPrior &prior);
+
+/**
+ * @brief Build the optical flow pyramid of an image
+ * @param[in] image
+ * @param[in] param
+ * @param[out] pyramid
+ */
+void buildTrackingPyramid(const openMVG::image::Image<unsigned char> &image,
+                          const TrackingParameters &param,
+                          std::vector<cv::Mat> &pyramid);
+
+/**
+ * @brief Localize a frame from the previous frame prior
+ * The prior 3D points are reprojected with the previous pose, and only matched
+ * with the query features around their reprojection. The matched images of the
+ * previous frame are kept in the result.
+ * @param[in] prior
+ * @param[in] queryRegions
+ * @param[in] imageSize
+ * @param[in] param
+ * @param[in] hasIntrinsics - use queryIntrinsics instead of the prior intrinsics
+ * @param[in] queryIntrinsics
+ * @param[out] localizationResult
+ * @return true if the frame is localized with at least param.minInliers inliers
+ */
+bool localizeFromPrior(const TrackingPrior &prior,
+                       const openMVG::features::SIFT_Regions &queryRegions,
+                       const std::pair<std::size_t, std::size_t> &imageSize,
+                       const TrackingParameters &param,
+                       bool hasIntrinsics,
+                       const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &queryIntrinsics,
+                       openMVG::localization::LocalizationResult &localizationResult);
+
+/**
+ * @brief Localize a frame by tracking the prior observations with a pyramidal optical flow
+ * Tracks are kept if they pass a forward-backward check. No features are
+ * extracted, the tracked points are returned as features with the descriptors
+ * of their landmark.
+ * @param[in] prior
+ * @param[in] pyramid - pyramid of the frame
+ * @param[in] imageSize
+ * @param[in] param
+ * @param[in] hasIntrinsics - use queryIntrinsics instead of the prior intrinsics
+ * @param[in] queryIntrinsics
+ * @param[out] localizationResult
+ * @param[out] features - the tracked points
+ * @param[out] descriptors - one per tracked point
+ * @return true if at least param.minTracks points are tracked and the frame is
+ * localized with at least param.minInliers inliers
+ */
+bool localizeFromOpticalFlow(const TrackingPrior &prior,
+                             const std::vector<cv::Mat> &pyramid,
+                             const std::pair<std::size_t, std::size_t> &imageSize,
+                             const TrackingParameters &param,
+                             bool hasIntrinsics,
+                             const openMVG::cameras::Pinhole_Intrinsic_Radial_K3 &queryIntrinsics,
+                             openMVG::localization::LocalizationResult &localizationResult,
+                             std::vector<openMVG::features::SIOPointFeature> &features,
+                             std::vector<openMVG::features::SIFT_Regions::DescriptorT> &descriptors);
+
+} //namespace Localizer
+} //namespace openMVG_ofx